@@ -23,8 +23,22 @@ typedef bool(*NR_Server_Base_SetGlyph)(NR_Server_Base, unsigned int, unsigned in
 typedef bool(*NR_Server_Base_GetGlyph)(NR_Server_Base, unsigned int, unsigned int, NR_Glyph*);
 
 typedef bool(*NR_Server_Base_Text)(NR_Server_Base, unsigned int x, unsigned int y, const char* text, unsigned int color, unsigned int bgColor, bool flash);
+typedef bool(*NR_Server_Base_TextBox)(NR_Server_Base, unsigned int x, unsigned int y, unsigned int w, unsigned int h, const char* text,
+                                      unsigned int color, unsigned int bgColor, bool flash,
+                                      NR_Wrap wrap, NR_Align align, NR_Overflow overflow, unsigned int* bytesConsumed);
+typedef bool(*NR_Server_Base_RichText)(NR_Server_Base, unsigned int x, unsigned int y, const char* text, unsigned int color, unsigned int bgColor, bool flash,
+                                       const NR_Text_Span* spans, unsigned int spanCount);
+typedef bool(*NR_Server_Base_StyledText)(NR_Server_Base, unsigned int x, unsigned int y, const char* text, unsigned short style);
 typedef bool(*NR_Server_Base_Rectangle)(NR_Server_Base, unsigned int x, unsigned int y, unsigned int w, unsigned int h, bool fill, const NR_Glyph* glyph);
 
+typedef bool(*NR_Server_Base_RegisterStyle)(NR_Server_Base, const NR_Style* style, unsigned short* id);
+typedef bool(*NR_Server_Base_SetStyle)(NR_Server_Base, unsigned short id, const NR_Style* style);
+
+typedef bool(*NR_Server_Base_SetColorMode)(NR_Server_Base, NR_ColorMode mode);
+typedef bool(*NR_Server_Base_SetPalette)(NR_Server_Base, unsigned int start, unsigned int count, const unsigned int* colors);
+
+typedef bool(*NR_Server_Base_PrewarmGlyphs)(NR_Server_Base, const NR_Codepoint_Range* ranges, unsigned int count);
+
 typedef bool(*NR_Server_Base_Clear)(NR_Server_Base, const NR_Glyph*);
 typedef bool(*NR_Server_Base_SwapBuffers)(NR_Server_Base);
 
@@ -46,8 +60,19 @@ typedef struct {
   NR_Server_Base_GetGlyph getGlyph;
 
   NR_Server_Base_Text text;
+  NR_Server_Base_TextBox textBox;
+  NR_Server_Base_RichText richText;
+  NR_Server_Base_StyledText styledText;
   NR_Server_Base_Rectangle rectangle;
 
+  NR_Server_Base_RegisterStyle registerStyle;
+  NR_Server_Base_SetStyle setStyle;
+
+  NR_Server_Base_SetColorMode setColorMode;
+  NR_Server_Base_SetPalette setPalette;
+
+  NR_Server_Base_PrewarmGlyphs prewarmGlyphs;
+
   NR_Server_Base_Clear clear;
   NR_Server_Base_SwapBuffers swapBuffers;
 
@@ -63,6 +88,9 @@ void NR_Server_Base_Event(NR_Server_Base server, NR_Event* event);
 // Get user data
 void* NR_Server_Base_GetUserData(NR_Server_Base server);
 
+// The style everything should be drawn in whilst a display list is replayed (NR_STYLE_NONE if there isn't one).
+unsigned short NR_Server_Base_GetStyleOverride(NR_Server_Base server);
+
 // Trigger the server to stop.
 void NR_Server_Base_Quit(NR_Server_Base server);
 
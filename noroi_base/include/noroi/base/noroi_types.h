@@ -4,7 +4,44 @@
 #include <stdbool.h>
 #include <stdint.h>
 
-// Info for a glyph.
+// Styles are registered with the server once and then referred to by id. Id 0 is never registered and means
+// no style, and ids that haven't been registered are treated the same.
+#define NR_STYLE_NONE 0
+#define NR_MAX_STYLES 256
+
+typedef struct {
+  unsigned int color;
+  unsigned int bgColor;
+
+  bool flashing;
+  bool bold;
+  bool italic;
+} NR_Style;
+
+// Colours are either packed 0xRRGGBBAA values, or indices into a palette.
+#define NR_PALETTE_SIZE 256
+
+typedef enum {
+  NR_COLOR_MODE_RGBA,
+  NR_COLOR_MODE_PALETTE
+} NR_ColorMode;
+
+// The highest unicode codepoint.
+#define NR_MAX_CODEPOINT 0x10FFFF
+
+// An inclusive range of unicode codepoints.
+typedef struct {
+  unsigned int first, last;
+} NR_Codepoint_Range;
+
+// Ranges worth having ready before they're drawn.
+#define NR_RANGE_ASCII          { 0x0020, 0x007E }
+#define NR_RANGE_LATIN_1        { 0x00A0, 0x00FF }
+#define NR_RANGE_BOX_DRAWING    { 0x2500, 0x257F }
+#define NR_RANGE_BLOCK_ELEMENTS { 0x2580, 0x259F }
+
+// Info for a glyph. Zero initialize glyphs before filling them in (memset, or = { 0 }), so that any fields
+// you don't set, like style, mean nothing rather than whatever was on the stack.
 typedef struct {
   unsigned int codepoint;
   
@@ -14,8 +51,31 @@ typedef struct {
 
   unsigned int color;
   unsigned int bgColor;
+
+  // If this isn't NR_STYLE_NONE the colours and flags come from the style instead.
+  unsigned short style;
 } NR_Glyph;
 
+// How text wraps when it reaches the edge of a text box.
+typedef enum {
+  NR_WRAP_NONE, // Lines are cut off at the edge of the box.
+  NR_WRAP_CHAR, // Lines break at whichever character reaches the edge.
+  NR_WRAP_WORD  // Lines break at the last space before the edge where possible.
+} NR_Wrap;
+
+// Horizontal alignment of each line in a text box.
+typedef enum {
+  NR_ALIGN_LEFT,
+  NR_ALIGN_CENTER,
+  NR_ALIGN_RIGHT
+} NR_Align;
+
+// What to do with text that doesn't fit in a text box.
+typedef enum {
+  NR_OVERFLOW_CLIP,    // Just stop drawing.
+  NR_OVERFLOW_ELLIPSIS // Stop drawing, but put a '…' in the last cell to show there's more.
+} NR_Overflow;
+
 typedef enum {
   NR_BUTTON_LEFT,
   NR_BUTTON_MIDDLE,
@@ -64,7 +124,24 @@ typedef enum {
   NR_Request_Type_Text,
 
   NR_Request_Type_Clear,
-  NR_Request_Type_SwapBuffers
+  NR_Request_Type_SwapBuffers,
+
+  // New requests go on the end, so existing clients keep working.
+  NR_Request_Type_TextBox,
+  NR_Request_Type_RichText,
+  NR_Request_Type_StyledText,
+
+  NR_Request_Type_RegisterStyle,
+  NR_Request_Type_SetStyle,
+
+  NR_Request_Type_SetColorMode,
+  NR_Request_Type_SetPalette,
+
+  NR_Request_Type_BeginList,
+  NR_Request_Type_EndList,
+  NR_Request_Type_CallList,
+
+  NR_Request_Type_PrewarmGlyphs
 } NR_Request_Type;
 
 // http://stackoverflow.com/questions/2060974/how-to-include-a-dynamic-array-inside-a-struct-in-c
@@ -104,6 +181,42 @@ typedef struct {
   char text[];
 } NR_Request_Text_Contents;
 
+typedef struct {
+  unsigned int x, y;
+  unsigned int w, h;
+  unsigned int color;
+  unsigned int bgColor;
+  bool flash;
+  NR_Wrap wrap;
+  NR_Align align;
+  NR_Overflow overflow;
+  char text[];
+} NR_Request_TextBox_Contents;
+
+// Style for a run of bytes in a rich text request.
+typedef struct {
+  unsigned short offset, length;
+  unsigned int color;
+  unsigned int bgColor;
+  bool flash;
+  unsigned short style; // Used instead of the colours above if it isn't NR_STYLE_NONE.
+} NR_Text_Span;
+
+typedef struct {
+  unsigned int x, y;
+  unsigned int color;
+  unsigned int bgColor;
+  bool flash;
+  unsigned int spanCount;
+  char data[]; // spanCount NR_Text_Spans sorted by offset, then the text itself.
+} NR_Request_RichText_Contents;
+
+typedef struct {
+  unsigned int x, y;
+  unsigned short style;
+  char text[];
+} NR_Request_StyledText_Contents;
+
 typedef struct {
   unsigned int x, y;
   unsigned int w, h;
@@ -115,6 +228,42 @@ typedef struct {
   NR_Glyph glyph;
 } NR_Request_Clear_Contents;
 
+typedef struct {
+  NR_Style style;
+} NR_Request_RegisterStyle_Contents;
+
+typedef struct {
+  unsigned short id;
+  NR_Style style;
+} NR_Request_SetStyle_Contents;
+
+typedef struct {
+  NR_ColorMode mode;
+} NR_Request_SetColorMode_Contents;
+
+typedef struct {
+  unsigned int start, count;
+  unsigned int colors[];
+} NR_Request_SetPalette_Contents;
+
+typedef struct {
+  unsigned int count;
+  NR_Codepoint_Range ranges[];
+} NR_Request_PrewarmGlyphs_Contents;
+
+// Display lists record draw requests on the server to be replayed later.
+#define NR_LIST_NAME_SIZE 32
+
+typedef struct {
+  char name[NR_LIST_NAME_SIZE];
+} NR_Request_BeginList_Contents;
+
+typedef struct {
+  int x, y;             // Added to the position of everything in the list.
+  unsigned short style; // If not NR_STYLE_NONE, everything in the list is drawn with this style.
+  char name[NR_LIST_NAME_SIZE];
+} NR_Request_CallList_Contents;
+
 // Header for a response message.
 typedef enum {
   NR_Response_Type_Success,
@@ -122,7 +271,9 @@ typedef enum {
 
   NR_Response_Type_GetSize,
   NR_Response_Type_GetCaption,
-  NR_Response_Type_GetGlyph
+  NR_Response_Type_GetGlyph,
+  NR_Response_Type_TextBox,
+  NR_Response_Type_RegisterStyle
 
 } NR_Response_Type;
 
@@ -145,4 +296,13 @@ typedef struct {
   NR_Glyph glyph;
 } NR_Response_GetGlyph_Contents;
 
+typedef struct {
+  // How many bytes of the text were laid out. Send the text from this offset to carry on in another box.
+  unsigned int bytesConsumed;
+} NR_Response_TextBox_Contents;
+
+typedef struct {
+  unsigned short id;
+} NR_Response_RegisterStyle_Contents;
+
 #endif
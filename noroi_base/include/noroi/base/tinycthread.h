@@ -432,6 +432,29 @@ void *tss_get(tss_t key);
 */
 int tss_set(tss_t key, void *val);
 
+/* One-time initialization */
+#if defined(_TTHREAD_WIN32_)
+typedef struct {
+  LONG volatile status;
+  CRITICAL_SECTION lock;
+} once_flag;
+#define ONCE_FLAG_INIT {0,}
+#else
+#define once_flag pthread_once_t
+#define ONCE_FLAG_INIT PTHREAD_ONCE_INIT
+#endif
+
+/** Invoke a callback exactly once.
+* @param flag Flag used to ensure the callback is invoked exactly
+*        once. It must be initialized with @ref ONCE_FLAG_INIT.
+* @param func Callback to invoke.
+*/
+#if defined(_TTHREAD_WIN32_)
+void call_once(once_flag *flag, void (*func)(void));
+#else
+#define call_once(flag,func) pthread_once(flag,func)
+#endif
+
 
 #endif /* _TINYTHREAD_H_ */
 
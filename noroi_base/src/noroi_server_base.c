@@ -5,10 +5,32 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 
 #include <noroi/base/tinycthread.h>
 #include <zmq.h>
 
+// The biggest request we'll accept. Text requests can get fairly long.
+#define MAX_REQUEST_SIZE (64 * 1024)
+
+// Display lists.
+#define MAX_DISPLAY_LISTS 64
+#define MAX_DISPLAY_LIST_DEPTH 8
+#define MAX_DISPLAY_LIST_SIZE (1024 * 1024)
+
+// Comes before each request in a display list, so we know how far to step to the next one.
+typedef struct {
+  unsigned int size;
+  unsigned int padding;
+} DisplayListEntry;
+
+// A recorded sequence of requests, stored back to back.
+typedef struct {
+  char name[NR_LIST_NAME_SIZE];
+  char* data;
+  unsigned int size, capacity;
+} DisplayList;
+
 typedef struct {
   // Thread we are running on.
   thrd_t threadId;
@@ -24,6 +46,21 @@ typedef struct {
   void* responder;
   void* publisher;
 
+  // Buffer to receive requests into.
+  char* requestBuffer;
+
+  // Display lists, and the one we're currently recording into (if any).
+  DisplayList lists[MAX_DISPLAY_LISTS];
+  unsigned int listCount;
+  DisplayList* recording;
+
+  // How many lists deep we're replaying, and the style to replay them in.
+  unsigned int replayDepth;
+  unsigned short styleOverride;
+
+  // The last reply sent, so we know whether a request succeeded once it's been handled.
+  NR_Response_Type lastReply;
+
   // Server config.
   NR_Server_Base_Callbacks callbacks;
 
@@ -53,10 +90,147 @@ static void _successOrError(NR_Server_Base server, bool success, const char* err
         break; \
       } \
 
+static void _handleRequest(NR_Server_Base server, void* data, unsigned int size);
+
+static DisplayList* _findList(InternalData* internal, const char* name) {
+  for (unsigned int i = 0; i < internal->listCount; ++i) {
+    if (strncmp(internal->lists[i].name, name, NR_LIST_NAME_SIZE) == 0)
+      return &internal->lists[i];
+  }
+  return (void*)0;
+}
+
+// Whether a request draws something and so belongs in a display list.
+static bool _isRecordable(NR_Request_Type type) {
+  switch (type) {
+    case NR_Request_Type_SetGlyph:
+    case NR_Request_Type_Rectangle:
+    case NR_Request_Type_Text:
+    case NR_Request_Type_TextBox:
+    case NR_Request_Type_RichText:
+    case NR_Request_Type_StyledText:
+    case NR_Request_Type_Clear:
+    case NR_Request_Type_CallList:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// How much room a request takes up in a display list. Each is kept aligned so its contents can be read in place.
+static unsigned int _entrySize(unsigned int size) {
+  return (sizeof(DisplayListEntry) + size + 7) & ~7u;
+}
+
+static bool _listHasRoom(const DisplayList* list, unsigned int size) {
+  return list->size + _entrySize(size) <= MAX_DISPLAY_LIST_SIZE;
+}
+
+static void _recordRequest(DisplayList* list, const void* data, unsigned int size) {
+  unsigned int alignedSize = _entrySize(size);
+  if (list->size + alignedSize > list->capacity) {
+    list->capacity = (list->size + alignedSize) * 2;
+    list->data = realloc(list->data, list->capacity);
+  }
+
+  DisplayListEntry* entry = (DisplayListEntry*)(list->data + list->size);
+  entry->size = size;
+  entry->padding = 0;
+  memcpy(list->data + list->size + sizeof(DisplayListEntry), data, size);
+  list->size += alignedSize;
+}
+
+// Move a request by x, y. Everything that draws at a position has it first in its contents.
+// Returns false if the request is malformed, or would be moved off the top or left of the screen.
+static bool _offsetRequest(NR_Request_Header* header, int x, int y) {
+  if (header->type == NR_Request_Type_Clear)
+    return true;
+
+  if (header->type == NR_Request_Type_CallList) {
+    if (header->size < sizeof(NR_Request_CallList_Contents))
+      return false;
+
+    // Nested lists can be moved back on screen, so they only have to stay in range.
+    NR_Request_CallList_Contents* contents = (NR_Request_CallList_Contents*)header->contents;
+    long long newX = (long long)contents->x + x;
+    long long newY = (long long)contents->y + y;
+    if (newX < INT_MIN || newX > INT_MAX || newY < INT_MIN || newY > INT_MAX)
+      return false;
+
+    contents->x = (int)newX;
+    contents->y = (int)newY;
+    return true;
+  }
+
+  if (header->size < 2 * sizeof(unsigned int))
+    return false;
+
+  unsigned int* position = (unsigned int*)header->contents;
+  long long newX = (long long)position[0] + x;
+  long long newY = (long long)position[1] + y;
+  if (newX < 0 || newX > UINT_MAX || newY < 0 || newY > UINT_MAX)
+    return false;
+
+  position[0] = (unsigned int)newX;
+  position[1] = (unsigned int)newY;
+  return true;
+}
+
+static bool _callList(NR_Server_Base server, const NR_Request_CallList_Contents* call) {
+  InternalData* internal = (InternalData*)server;
+
+  DisplayList* list = _findList(internal, call->name);
+  if (!list || internal->replayDepth >= MAX_DISPLAY_LIST_DEPTH)
+    return false;
+
+  // Nothing replayed sends a reply, and the outermost style override wins.
+  unsigned short oldOverride = internal->styleOverride;
+  if (oldOverride == NR_STYLE_NONE)
+    internal->styleOverride = call->style;
+  internal->replayDepth++;
+
+  // Copy each request out so we can move it without changing the list.
+  char* buffer = malloc(list->size);
+  memcpy(buffer, list->data, list->size);
+  unsigned int pos = 0;
+  while (pos < list->size) {
+    DisplayListEntry* entry = (DisplayListEntry*)(buffer + pos);
+    NR_Request_Header* header = (NR_Request_Header*)(buffer + pos + sizeof(DisplayListEntry));
+
+    if (_offsetRequest(header, call->x, call->y))
+      _handleRequest(server, header, entry->size);
+
+    pos += _entrySize(entry->size);
+  }
+  free(buffer);
+
+  internal->replayDepth--;
+  internal->styleOverride = oldOverride;
+
+  return true;
+}
+
 static void _handleRequest(NR_Server_Base server, void* data, unsigned int size) {
   NR_Request_Header* requestHeader = (NR_Request_Header*)data;
   InternalData* internalData = (InternalData*)server;
 
+  // Make sure the request is exactly as big as it says it is.
+  if (size < sizeof(NR_Request_Header) || requestHeader->size != size - sizeof(NR_Request_Header)) {
+    const char* error = "Request size doesn't match its header.";
+    NR_Server_Base_Reply(server, NR_Response_Type_Failure, error, strlen(error));
+    return;
+  }
+
+  // Keep a copy of anything that draws whilst recording a display list, once it's succeeded.
+  // Make sure it'll fit before drawing it, so it can't be drawn but left out.
+  bool record = internalData->recording && internalData->replayDepth == 0 && _isRecordable(requestHeader->type);
+  if (record && !_listHasRoom(internalData->recording, size)) {
+    const char* error = "Display list is full.";
+    NR_Server_Base_Reply(server, NR_Response_Type_Failure, error, strlen(error));
+    return;
+  }
+  internalData->lastReply = NR_Response_Type_Failure;
+
   // Figure out what the request was.
   switch (requestHeader->type) {
     // Font face.
@@ -121,12 +295,127 @@ static void _handleRequest(NR_Server_Base server, void* data, unsigned int size)
       _successOrError(server, internalData->callbacks.text(server, contents->x, contents->y, contents->text, contents->color, contents->bgColor, contents->flash), "Error ocurred calling Text");
     } NOROI_SERVER_BASE_HANDLE_REQUEST_END;
 
+    // Text laid out in a box.
+    NOROI_SERVER_BASE_HANDLE_REQUEST_BEGIN(NR_Request_Type_TextBox, internalData->callbacks.textBox) {
+      NR_Request_TextBox_Contents* contents = (NR_Request_TextBox_Contents*)requestHeader->contents;
+      NR_Response_TextBox_Contents response;
+      if (internalData->callbacks.textBox(server, contents->x, contents->y, contents->w, contents->h, contents->text,
+                                          contents->color, contents->bgColor, contents->flash,
+                                          contents->wrap, contents->align, contents->overflow, &response.bytesConsumed)) {
+        NR_Server_Base_Reply(server, NR_Response_Type_TextBox, &response, sizeof(response));
+      } else {
+        const char* error = "Error ocurred calling TextBox.";
+        NR_Server_Base_Reply(server, NR_Response_Type_Failure, error, strlen(error));
+      }
+    } NOROI_SERVER_BASE_HANDLE_REQUEST_END;
+
+    // Text with spans of different styles.
+    NOROI_SERVER_BASE_HANDLE_REQUEST_BEGIN(NR_Request_Type_RichText, internalData->callbacks.richText) {
+      NR_Request_RichText_Contents* contents = (NR_Request_RichText_Contents*)requestHeader->contents;
+
+      // Make sure the spans don't run off the end of the request.
+      unsigned int available = size - sizeof(NR_Request_Header);
+      if (available < sizeof(NR_Request_RichText_Contents) ||
+          contents->spanCount > (available - sizeof(NR_Request_RichText_Contents)) / sizeof(NR_Text_Span)) {
+        const char* error = "RichText request has more spans than fit in it.";
+        NR_Server_Base_Reply(server, NR_Response_Type_Failure, error, strlen(error));
+        break;
+      }
+
+      // The text is whatever's left, and has to end inside the request.
+      unsigned int spansSize = contents->spanCount * sizeof(NR_Text_Span);
+      const NR_Text_Span* spans = (const NR_Text_Span*)contents->data;
+      const char* text = contents->data + spansSize;
+      if (!memchr(text, '\0', available - sizeof(NR_Request_RichText_Contents) - spansSize)) {
+        const char* error = "RichText request text isn't terminated.";
+        NR_Server_Base_Reply(server, NR_Response_Type_Failure, error, strlen(error));
+        break;
+      }
+      _successOrError(server, internalData->callbacks.richText(server, contents->x, contents->y, text, contents->color, contents->bgColor, contents->flash,
+                                                               spans, contents->spanCount), "Error ocurred calling RichText");
+    } NOROI_SERVER_BASE_HANDLE_REQUEST_END;
+
+    // Text in a registered style.
+    NOROI_SERVER_BASE_HANDLE_REQUEST_BEGIN(NR_Request_Type_StyledText, internalData->callbacks.styledText) {
+      NR_Request_StyledText_Contents* contents = (NR_Request_StyledText_Contents*)requestHeader->contents;
+      _successOrError(server, internalData->callbacks.styledText(server, contents->x, contents->y, contents->text, contents->style), "Error ocurred calling StyledText");
+    } NOROI_SERVER_BASE_HANDLE_REQUEST_END;
+
     // Rectangle.
     NOROI_SERVER_BASE_HANDLE_REQUEST_BEGIN(NR_Request_Type_Rectangle, internalData->callbacks.rectangle) {
       NR_Request_Rectangle_Contents* contents = (NR_Request_Rectangle_Contents*)requestHeader->contents;
       _successOrError(server, internalData->callbacks.rectangle(server, contents->x, contents->y, contents->w, contents->h, contents->fill, &contents->glyph), "Error ocurred calling Rectangle");
     } NOROI_SERVER_BASE_HANDLE_REQUEST_END;
 
+    // Styles.
+    NOROI_SERVER_BASE_HANDLE_REQUEST_BEGIN(NR_Request_Type_RegisterStyle, internalData->callbacks.registerStyle) {
+      NR_Request_RegisterStyle_Contents* contents = (NR_Request_RegisterStyle_Contents*)requestHeader->contents;
+      NR_Response_RegisterStyle_Contents response;
+      if (internalData->callbacks.registerStyle(server, &contents->style, &response.id)) {
+        NR_Server_Base_Reply(server, NR_Response_Type_RegisterStyle, &response, sizeof(response));
+      } else {
+        const char* error = "Error ocurred calling RegisterStyle.";
+        NR_Server_Base_Reply(server, NR_Response_Type_Failure, error, strlen(error));
+      }
+    } NOROI_SERVER_BASE_HANDLE_REQUEST_END;
+
+    NOROI_SERVER_BASE_HANDLE_REQUEST_BEGIN(NR_Request_Type_SetStyle, internalData->callbacks.setStyle) {
+      NR_Request_SetStyle_Contents* contents = (NR_Request_SetStyle_Contents*)requestHeader->contents;
+      _successOrError(server, internalData->callbacks.setStyle(server, contents->id, &contents->style), "Error occurred calling SetStyle.");
+    } NOROI_SERVER_BASE_HANDLE_REQUEST_END;
+
+    // Palette.
+    NOROI_SERVER_BASE_HANDLE_REQUEST_BEGIN(NR_Request_Type_SetColorMode, internalData->callbacks.setColorMode) {
+      NR_Request_SetColorMode_Contents* contents = (NR_Request_SetColorMode_Contents*)requestHeader->contents;
+      _successOrError(server, internalData->callbacks.setColorMode(server, contents->mode), "Error occurred calling SetColorMode.");
+    } NOROI_SERVER_BASE_HANDLE_REQUEST_END;
+
+    NOROI_SERVER_BASE_HANDLE_REQUEST_BEGIN(NR_Request_Type_SetPalette, internalData->callbacks.setPalette) {
+      NR_Request_SetPalette_Contents* contents = (NR_Request_SetPalette_Contents*)requestHeader->contents;
+
+      // Make sure all the colours are actually in the request.
+      if (requestHeader->size < sizeof(NR_Request_SetPalette_Contents) || contents->count > NR_PALETTE_SIZE ||
+          sizeof(NR_Request_SetPalette_Contents) + contents->count * sizeof(unsigned int) > requestHeader->size) {
+        const char* error = "SetPalette request has more colours than fit in it.";
+        NR_Server_Base_Reply(server, NR_Response_Type_Failure, error, strlen(error));
+        break;
+      }
+
+      _successOrError(server, internalData->callbacks.setPalette(server, contents->start, contents->count, contents->colors), "Error occurred calling SetPalette.");
+    } NOROI_SERVER_BASE_HANDLE_REQUEST_END;
+
+    // Glyphs.
+    NOROI_SERVER_BASE_HANDLE_REQUEST_BEGIN(NR_Request_Type_PrewarmGlyphs, internalData->callbacks.prewarmGlyphs) {
+      NR_Request_PrewarmGlyphs_Contents* contents = (NR_Request_PrewarmGlyphs_Contents*)requestHeader->contents;
+
+      // Make sure all the ranges are actually in the request.
+      unsigned int available = size - sizeof(NR_Request_Header);
+      if (available < sizeof(NR_Request_PrewarmGlyphs_Contents) ||
+          contents->count > (available - sizeof(NR_Request_PrewarmGlyphs_Contents)) / sizeof(NR_Codepoint_Range)) {
+        const char* error = "PrewarmGlyphs request has more ranges than fit in it.";
+        NR_Server_Base_Reply(server, NR_Response_Type_Failure, error, strlen(error));
+        break;
+      }
+
+      // Keep the ranges to real codepoints.
+      bool valid = true;
+      for (unsigned int i = 0; i < contents->count; ++i) {
+        NR_Codepoint_Range* range = &contents->ranges[i];
+        if (range->last > NR_MAX_CODEPOINT)
+          range->last = NR_MAX_CODEPOINT;
+        if (range->first > range->last)
+          valid = false;
+      }
+
+      if (!valid) {
+        const char* error = "PrewarmGlyphs request has a range that ends before it starts.";
+        NR_Server_Base_Reply(server, NR_Response_Type_Failure, error, strlen(error));
+        break;
+      }
+
+      _successOrError(server, internalData->callbacks.prewarmGlyphs(server, contents->ranges, contents->count), "Error occurred calling PrewarmGlyphs.");
+    } NOROI_SERVER_BASE_HANDLE_REQUEST_END;
+
     // Clear.
     NOROI_SERVER_BASE_HANDLE_REQUEST_BEGIN(NR_Request_Type_Clear, internalData->callbacks.clear) {
       NR_Request_Clear_Contents* contents = (NR_Request_Clear_Contents*)requestHeader->contents;
@@ -138,6 +427,46 @@ static void _handleRequest(NR_Server_Base server, void* data, unsigned int size)
       _successOrError(server, internalData->callbacks.swapBuffers(server), "Error occurred calling SwapBuffers.");
     } NOROI_SERVER_BASE_HANDLE_REQUEST_END;
 
+    // Display lists.
+    case NR_Request_Type_BeginList:
+      {
+        NR_Request_BeginList_Contents* contents = (NR_Request_BeginList_Contents*)requestHeader->contents;
+        contents->name[NR_LIST_NAME_SIZE - 1] = '\0';
+
+        // Record over the list if it already exists, otherwise make a new one.
+        DisplayList* list = _findList(internalData, contents->name);
+        if (!list && internalData->listCount < MAX_DISPLAY_LISTS) {
+          list = &internalData->lists[internalData->listCount++];
+          memset(list, 0, sizeof(DisplayList));
+          strcpy(list->name, contents->name);
+        }
+
+        bool success = list && !internalData->recording;
+        if (success) {
+          list->size = 0;
+          internalData->recording = list;
+        }
+
+        _successOrError(server, success, "Error occurred calling BeginList.");
+        break;
+      }
+
+    case NR_Request_Type_EndList:
+      {
+        bool success = internalData->recording;
+        internalData->recording = (void*)0;
+        _successOrError(server, success, "EndList called without BeginList.");
+        break;
+      }
+
+    case NR_Request_Type_CallList:
+      {
+        NR_Request_CallList_Contents* contents = (NR_Request_CallList_Contents*)requestHeader->contents;
+        contents->name[NR_LIST_NAME_SIZE - 1] = '\0';
+        _successOrError(server, _callList(server, contents), "Error occurred calling CallList.");
+        break;
+      }
+
     default:
       {
         // Construct an error message.
@@ -147,6 +476,9 @@ static void _handleRequest(NR_Server_Base server, void* data, unsigned int size)
         break;
       }
   }
+
+  if (record && internalData->lastReply != NR_Response_Type_Failure)
+    _recordRequest(internalData->recording, data, size);
 }
 
 static int _runServer(void* data) {
@@ -182,13 +514,19 @@ static int _runServer(void* data) {
   while (internal->running) {
 
     // Handle any requests.
-    char buffer[1024];
     while (true) {
-      int bytes = zmq_recv(internal->responder, buffer, 1024, ZMQ_NOBLOCK);
+      int bytes = zmq_recv(internal->responder, internal->requestBuffer, MAX_REQUEST_SIZE, ZMQ_NOBLOCK);
       if (bytes == -1)
         break;
 
-      _handleRequest(data, buffer, bytes);
+      // zmq truncates messages that don't fit, so refuse them rather than reading half a request.
+      if (bytes > MAX_REQUEST_SIZE) {
+        const char* error = "Request was too large.";
+        NR_Server_Base_Reply(data, NR_Response_Type_Failure, error, strlen(error));
+        continue;
+      }
+
+      _handleRequest(data, internal->requestBuffer, bytes);
     }
 
     // Update our window.
@@ -214,6 +552,16 @@ NR_Server_Base NR_Server_Base_New(NR_Context* context, const char* replyAddress,
   // User data
   internal->userData = userData;
 
+  // Somewhere to put requests.
+  internal->requestBuffer = malloc(MAX_REQUEST_SIZE);
+
+  // No display lists yet.
+  internal->listCount = 0;
+  internal->recording = (void*)0;
+  internal->replayDepth = 0;
+  internal->styleOverride = NR_STYLE_NONE;
+  internal->lastReply = NR_Response_Type_Success;
+
   // The NR_Context.
   internal->context = context;
 
@@ -244,6 +592,10 @@ void NR_Server_Base_Delete(NR_Server_Base server) {
   // Free anything we allocated.
   free(internal->replyAddress);
   free(internal->publisherAddress);
+  free(internal->requestBuffer);
+  for (unsigned int i = 0; i < internal->listCount; ++i) {
+    free(internal->lists[i].data);
+  }
 
   // Finaly free the whole handle.
   free(internal);
@@ -251,6 +603,11 @@ void NR_Server_Base_Delete(NR_Server_Base server) {
 
 void NR_Server_Base_Reply(NR_Server_Base server, NR_Response_Type type, const void* data, unsigned int size) {
   InternalData* internal = (InternalData*)server;
+  internal->lastReply = type;
+
+  // Requests replayed from a display list don't get replies, only the CallList does.
+  if (internal->replayDepth > 0)
+    return;
 
   // Allocate a header.
   NR_Response_Header* header = malloc(sizeof(NR_Response_Header) + size);
@@ -276,6 +633,11 @@ void* NR_Server_Base_GetUserData(NR_Server_Base server) {
   return internal->userData;
 }
 
+unsigned short NR_Server_Base_GetStyleOverride(NR_Server_Base server) {
+  InternalData* internal = (InternalData*)server;
+  return internal->styleOverride;
+}
+
 // Trigger the server to stop.
 void NR_Server_Base_Quit(NR_Server_Base server) {
   InternalData* internal = (InternalData*)server;
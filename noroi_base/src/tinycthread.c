@@ -568,6 +568,39 @@ int tss_set(tss_t key, void *val)
   return thrd_success;
 }
 
+#if defined(_TTHREAD_WIN32_)
+void call_once(once_flag *flag, void (*func)(void))
+{
+  /* A spin lock (via InterlockedCompareExchange) keeps everyone out of the
+     critical section until it has been initialized, then the critical section
+     blocks until the callback has finished. */
+  while (flag->status < 3)
+  {
+    switch (flag->status)
+    {
+      case 0:
+        if (InterlockedCompareExchange(&(flag->status), 1, 0) == 0)
+        {
+          InitializeCriticalSection(&(flag->lock));
+          EnterCriticalSection(&(flag->lock));
+          flag->status = 2;
+          func();
+          flag->status = 3;
+          LeaveCriticalSection(&(flag->lock));
+          return;
+        }
+        break;
+      case 1:
+        break;
+      case 2:
+        EnterCriticalSection(&(flag->lock));
+        LeaveCriticalSection(&(flag->lock));
+        break;
+    }
+  }
+}
+#endif
+
 #if defined(_TTHREAD_EMULATE_CLOCK_GETTIME_)
 int _tthread_clock_gettime(clockid_t clk_id, struct timespec *ts)
 {
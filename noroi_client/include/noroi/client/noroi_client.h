@@ -40,6 +40,42 @@ void NR_Client_Rectangle(NR_Client client, int x, int y, int w, int h, const NR_
 // Draw text
 void NR_Client_Text(NR_Client client, int x, int y, const char* text, unsigned int color, unsigned int bgColor, bool flash);
 
+// Draw text, styling each span of bytes differently. Spans must be sorted by offset and not overlap.
+void NR_Client_RichText(NR_Client client, int x, int y, const char* text, unsigned int color, unsigned int bgColor, bool flash,
+                        const NR_Text_Span* spans, unsigned int spanCount);
+
+// Draw text in a registered style.
+void NR_Client_StyledText(NR_Client client, int x, int y, const char* text, unsigned short style);
+
+// Draw text wrapped inside a box. Returns how many bytes of text fit, so the rest can be drawn in another box.
+unsigned int NR_Client_TextBox(NR_Client client, int x, int y, int w, int h, const char* text, unsigned int color, unsigned int bgColor, bool flash,
+                               NR_Wrap wrap, NR_Align align, NR_Overflow overflow);
+
+// Register a style, returning the id to use it with (NR_STYLE_NONE on failure).
+unsigned short NR_Client_RegisterStyle(NR_Client client, const NR_Style* style);
+
+// Change a registered style. Everything drawn with it changes too.
+void NR_Client_SetStyle(NR_Client client, unsigned short id, const NR_Style* style);
+
+// Switch between packed RGBA colours and palette indices.
+void NR_Client_SetColorMode(NR_Client client, NR_ColorMode mode);
+
+// Set count palette entries from start. Changes the colour of everything drawn with them.
+void NR_Client_SetPalette(NR_Client client, unsigned int start, unsigned int count, const unsigned int* colors);
+
+// Have the glyphs in count codepoint ranges rendered in the background, so they're ready before they're drawn.
+// The ranges are kept, and rendered again whenever the font changes.
+void NR_Client_PrewarmGlyphs(NR_Client client, const NR_Codepoint_Range* ranges, unsigned int count);
+
+// Record draw requests into a named display list on the server. Requests are still drawn as they're recorded,
+// and any that fail are left out.
+bool NR_Client_BeginList(NR_Client client, const char* name);
+bool NR_Client_EndList(NR_Client client);
+
+// Replay a display list moved by x, y. If style isn't NR_STYLE_NONE everything in it is drawn in that style.
+// Anything whose position is moved off the top or left of the screen is skipped.
+bool NR_Client_CallList(NR_Client client, const char* name, int x, int y, unsigned short style);
+
 // Clear everything.
 void NR_Client_Clear(NR_Client client, const NR_Glyph* glyph);
 
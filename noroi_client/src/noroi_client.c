@@ -241,6 +241,158 @@ void NR_Client_Text(NR_Client client, int x, int y, const char* text, unsigned i
   free(contents);
 }
 
+void NR_Client_RichText(NR_Client client, int x, int y, const char* text, unsigned int color, unsigned int bgColor, bool flash,
+                        const NR_Text_Span* spans, unsigned int spanCount) {
+  // Create the request, the spans go first then the text.
+  unsigned int spansSize = sizeof(NR_Text_Span) * spanCount;
+  int contentsSize = sizeof(NR_Request_RichText_Contents) + spansSize + strlen(text) + 1;
+  NR_Request_RichText_Contents* contents = (NR_Request_RichText_Contents*)malloc(contentsSize);
+  contents->x = x;
+  contents->y = y;
+  contents->color = color;
+  contents->bgColor = bgColor;
+  contents->flash = flash;
+  contents->spanCount = spanCount;
+  memcpy(contents->data, spans, spansSize);
+  strcpy(contents->data + spansSize, text);
+
+  // Send it.
+  NR_Client_Send(client, NR_Request_Type_RichText, contents, contentsSize, (void*)0, 0);
+
+  // Free the contents we allocated.
+  free(contents);
+}
+
+void NR_Client_StyledText(NR_Client client, int x, int y, const char* text, unsigned short style) {
+  // Create the request.
+  int contentsSize = sizeof(NR_Request_StyledText_Contents) + strlen(text) + 1;
+  NR_Request_StyledText_Contents* contents = (NR_Request_StyledText_Contents*)malloc(contentsSize);
+  contents->x = x;
+  contents->y = y;
+  contents->style = style;
+  strcpy(contents->text, text);
+
+  // Send it.
+  NR_Client_Send(client, NR_Request_Type_StyledText, contents, contentsSize, (void*)0, 0);
+
+  // Free the contents we allocated.
+  free(contents);
+}
+
+unsigned int NR_Client_TextBox(NR_Client client, int x, int y, int w, int h, const char* text, unsigned int color, unsigned int bgColor, bool flash,
+                               NR_Wrap wrap, NR_Align align, NR_Overflow overflow) {
+  // Create the request.
+  int contentsSize = sizeof(NR_Request_TextBox_Contents) + strlen(text) + 1;
+  NR_Request_TextBox_Contents* contents = (NR_Request_TextBox_Contents*)malloc(contentsSize);
+  contents->x = x;
+  contents->y = y;
+  contents->w = w;
+  contents->h = h;
+  contents->color = color;
+  contents->bgColor = bgColor;
+  contents->flash = flash;
+  contents->wrap = wrap;
+  contents->align = align;
+  contents->overflow = overflow;
+  strcpy(contents->text, text);
+
+  // A buffer the correct size to contain the response.
+  char buffer[sizeof(NR_Response_Header) + sizeof(NR_Response_TextBox_Contents)];
+  NR_Response_Header* header = (NR_Response_Header*)buffer;
+  NR_Response_TextBox_Contents* response = (NR_Response_TextBox_Contents*)header->contents;
+
+  // Send it.
+  unsigned int bytesConsumed = 0;
+  if (NR_Client_Send(client, NR_Request_Type_TextBox, contents, contentsSize, header, sizeof(buffer)))
+    bytesConsumed = response->bytesConsumed;
+
+  // Free the contents we allocated.
+  free(contents);
+
+  return bytesConsumed;
+}
+
+// Styles
+unsigned short NR_Client_RegisterStyle(NR_Client client, const NR_Style* style) {
+  NR_Request_RegisterStyle_Contents contents;
+  contents.style = *style;
+
+  // A buffer the correct size to contain the response.
+  char buffer[sizeof(NR_Response_Header) + sizeof(NR_Response_RegisterStyle_Contents)];
+  NR_Response_Header* header = (NR_Response_Header*)buffer;
+  NR_Response_RegisterStyle_Contents* response = (NR_Response_RegisterStyle_Contents*)header->contents;
+
+  if (NR_Client_Send(client, NR_Request_Type_RegisterStyle, &contents, sizeof(contents), header, sizeof(buffer)))
+    return response->id;
+  return NR_STYLE_NONE;
+}
+
+void NR_Client_SetStyle(NR_Client client, unsigned short id, const NR_Style* style) {
+  NR_Request_SetStyle_Contents contents;
+  contents.id = id;
+  contents.style = *style;
+  NR_Client_Send(client, NR_Request_Type_SetStyle, &contents, sizeof(contents), (void*)0, 0);
+}
+
+// Palette
+void NR_Client_SetColorMode(NR_Client client, NR_ColorMode mode) {
+  NR_Request_SetColorMode_Contents contents;
+  contents.mode = mode;
+  NR_Client_Send(client, NR_Request_Type_SetColorMode, &contents, sizeof(contents), (void*)0, 0);
+}
+
+void NR_Client_SetPalette(NR_Client client, unsigned int start, unsigned int count, const unsigned int* colors) {
+  // Create the request.
+  int contentsSize = sizeof(NR_Request_SetPalette_Contents) + sizeof(unsigned int) * count;
+  NR_Request_SetPalette_Contents* contents = (NR_Request_SetPalette_Contents*)malloc(contentsSize);
+  contents->start = start;
+  contents->count = count;
+  memcpy(contents->colors, colors, sizeof(unsigned int) * count);
+
+  // Send it.
+  NR_Client_Send(client, NR_Request_Type_SetPalette, contents, contentsSize, (void*)0, 0);
+
+  // Free the contents we allocated.
+  free(contents);
+}
+
+// Glyphs
+void NR_Client_PrewarmGlyphs(NR_Client client, const NR_Codepoint_Range* ranges, unsigned int count) {
+  // Create the request.
+  int contentsSize = sizeof(NR_Request_PrewarmGlyphs_Contents) + sizeof(NR_Codepoint_Range) * count;
+  NR_Request_PrewarmGlyphs_Contents* contents = (NR_Request_PrewarmGlyphs_Contents*)malloc(contentsSize);
+  contents->count = count;
+  memcpy(contents->ranges, ranges, sizeof(NR_Codepoint_Range) * count);
+
+  // Send it.
+  NR_Client_Send(client, NR_Request_Type_PrewarmGlyphs, contents, contentsSize, (void*)0, 0);
+
+  // Free the contents we allocated.
+  free(contents);
+}
+
+// Display lists
+bool NR_Client_BeginList(NR_Client client, const char* name) {
+  NR_Request_BeginList_Contents contents;
+  memset(&contents, 0, sizeof(contents));
+  strncpy(contents.name, name, NR_LIST_NAME_SIZE - 1);
+  return NR_Client_Send(client, NR_Request_Type_BeginList, &contents, sizeof(contents), (void*)0, 0);
+}
+
+bool NR_Client_EndList(NR_Client client) {
+  return NR_Client_Send(client, NR_Request_Type_EndList, (void*)0, 0, (void*)0, 0);
+}
+
+bool NR_Client_CallList(NR_Client client, const char* name, int x, int y, unsigned short style) {
+  NR_Request_CallList_Contents contents;
+  memset(&contents, 0, sizeof(contents));
+  contents.x = x;
+  contents.y = y;
+  contents.style = style;
+  strncpy(contents.name, name, NR_LIST_NAME_SIZE - 1);
+  return NR_Client_Send(client, NR_Request_Type_CallList, &contents, sizeof(contents), (void*)0, 0);
+}
+
 // Clear everything.
 void NR_Client_Clear(NR_Client client, const NR_Glyph* glyph) {
   NR_Request_Clear_Contents contents;
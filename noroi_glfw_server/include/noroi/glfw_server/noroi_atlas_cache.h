@@ -0,0 +1,52 @@
+#ifndef NOROI_ATLAS_CACHE_INCLUDED
+#define NOROI_ATLAS_CACHE_INCLUDED
+
+#include <noroi/glfw_server/noroi_glyphpacker.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Bump whenever glyphs would be rendered, packed or laid out differently, so old caches are thrown away.
+#define NR_ATLAS_CACHE_VERSION 5
+
+// What a cache was made for. A cache is only used if all of it matches.
+typedef struct {
+  uint64_t fontHash; // NR_FontData_GetHash of the font.
+  unsigned int pageWidth, pageHeight;
+} NR_AtlasCache_Key;
+
+// A glyph in a cache, with the size and style it was rendered at. The glyph's variant isn't kept, it only
+// means something to whoever packed it.
+typedef struct {
+  NR_GlyphPacker_Glyph glyph;
+  int pixelWidth, pixelHeight;
+  unsigned int style;
+  bool distanceField;
+} NR_AtlasCache_Glyph;
+
+// A cache file of packed atlas pages and the glyphs on them, at every size, mapped into memory.
+typedef void* NR_AtlasCache;
+
+// Hash some data (64 bit FNV-1a).
+uint64_t NR_AtlasCache_Hash(const void* data, size_t size);
+
+// Map a cache file, returning null if there isn't one or it's stale or corrupt. Only the glyphs are checked
+// here, each page is checked when it's copied out so opening doesn't have to read them all.
+NR_AtlasCache NR_AtlasCache_Open(const char* path, const NR_AtlasCache_Key* key);
+void NR_AtlasCache_Close(NR_AtlasCache cache);
+
+// The glyphs, in the order they were packed onto each page. Adding each to its page of an empty packer, in this
+// order, puts them back where they were.
+unsigned int NR_AtlasCache_GetGlyphCount(NR_AtlasCache cache);
+void NR_AtlasCache_GetGlyph(NR_AtlasCache cache, unsigned int i, NR_AtlasCache_Glyph* glyph);
+
+// The pages, pageWidth * pageHeight 8 bit pixels each. Copying a page returns false if it's been damaged.
+unsigned int NR_AtlasCache_GetPageCount(NR_AtlasCache cache);
+bool NR_AtlasCache_CopyPage(NR_AtlasCache cache, unsigned int page, unsigned char* pixels);
+
+// Write a cache file. Null pages are saved blank. Readers never see a half written file.
+bool NR_AtlasCache_Save(const char* path, const NR_AtlasCache_Key* key, const NR_AtlasCache_Glyph* glyphs, unsigned int glyphCount,
+                        unsigned char* const* pages, unsigned int pageCount);
+
+#endif
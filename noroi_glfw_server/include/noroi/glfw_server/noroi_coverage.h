@@ -0,0 +1,19 @@
+#ifndef NOROI_COVERAGE_INCLUDED
+#define NOROI_COVERAGE_INCLUDED
+
+#include <stdbool.h>
+
+// The set of codepoints a face has glyphs for, as a bitmap split into blocks of 256 codepoints. Blocks
+// with nothing in them all share one empty block, so a face covering a few scripts stays small.
+typedef void* NR_Coverage;
+
+NR_Coverage NR_Coverage_New();
+void NR_Coverage_Delete(NR_Coverage coverage);
+
+// Add a codepoint. Codepoints past the end of unicode are ignored.
+void NR_Coverage_Add(NR_Coverage coverage, unsigned int codepoint);
+
+// Check for a codepoint in constant time.
+bool NR_Coverage_Has(NR_Coverage coverage, unsigned int codepoint);
+
+#endif
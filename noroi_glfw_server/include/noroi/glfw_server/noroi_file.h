@@ -0,0 +1,23 @@
+#ifndef NOROI_FILE_INCLUDED
+#define NOROI_FILE_INCLUDED
+
+#include <stdbool.h>
+
+// A whole file mapped read only into memory.
+typedef struct {
+  const unsigned char* data;
+  unsigned int size;
+  void* handle; // Platform specific.
+} NR_File_Mapping;
+
+// Map / unmap a file. Empty files can't be mapped.
+bool NR_File_Map(const char* path, NR_File_Mapping* mapping);
+void NR_File_Unmap(NR_File_Mapping* mapping);
+
+// Get the directory to keep cache files in, creating it if it doesn't exist yet.
+bool NR_File_GetCacheDirectory(char* buff, unsigned int buffSize);
+
+// Move the file at from over the top of to, so that readers see either the old file or the new one.
+bool NR_File_Replace(const char* from, const char* to);
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef NOROI_FONT_DATA_INCLUDED
+#define NOROI_FONT_DATA_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// A font's data in memory, shared by every face opened on it. Font files are mapped rather than read, so
+// only the parts freetype touches are ever loaded. Fonts are counted, and unmapped once the last face using
+// them has been closed. Safe to use from any thread.
+typedef void* NR_FontData;
+
+// Get the data for a font file, or a font descriptor if there's no file at path. Returns null if neither
+// can be found. Opening the same font again shares the data.
+NR_FontData NR_FontData_Open(const char* path);
+void NR_FontData_Release(NR_FontData font);
+
+const unsigned char* NR_FontData_GetData(NR_FontData font);
+unsigned int NR_FontData_GetSize(NR_FontData font);
+
+// Hash what identifies the font, with NR_AtlasCache_Hash: its size, header and table directory, which holds
+// a checksum of each table. Only the start of the font is read, so the rest doesn't have to be loaded.
+// Collections are hashed whole. The hash is kept after the first time.
+uint64_t NR_FontData_GetHash(NR_FontData font);
+
+#endif
@@ -2,26 +2,94 @@
 #define NOROI_GLFW_FONT_INCLUDED
 
 #include <noroi/base/noroi.h>
+#include <noroi/glfw_server/noroi_glfw_renderer.h>
 
 // Font definition.
 typedef void* NR_Font;
 
+// How cells get turned into quads on the GPU.
+typedef enum {
+  NR_FONT_PIPELINE_GEOMETRY,     // A point per cell, expanded by a geometry shader.
+  NR_FONT_PIPELINE_INSTANCED,    // An instanced unit quad per cell. Faster where geometry shaders are slow.
+  NR_FONT_PIPELINE_GRID_TEXTURE  // The grid uploaded as a texture and drawn as one quad. Vertex work doesn't
+                                 // grow with the grid, for very large grids.
+} NR_Font_Pipeline;
+
+// How glyphs are rendered into the atlas.
+typedef enum {
+  NR_FONT_RASTER_BITMAP, // Coverage at the font resolution. Sharpest at that size.
+  NR_FONT_RASTER_SDF     // Signed distance fields at one size, which stay sharp drawn at any size, so changing
+                         // the resolution renders nothing again. Drawn as bitmaps before freetype 2.11.
+} NR_Font_Raster;
+
+// How much work the last NR_Font_Draw took.
+typedef struct {
+  unsigned int cellsRebuilt;  // Cells whose vertex had to be rebuilt.
+  unsigned int cellsUploaded; // Cells uploaded to the GPU.
+  unsigned int cellUploads;   // Transfers of those cells. Nearby changes are uploaded together.
+  unsigned int cellsWaiting;  // Cells drawn without their glyph while it's being rendered.
+  unsigned int atlasUploads;  // Transfers of new glyphs to the atlas, at most one per page.
+  unsigned int glyphsEvicted; // Glyphs thrown out of the atlas to make room.
+  unsigned int pagesEvicted;  // Pages emptied to make room, least recently used first.
+  unsigned int atlasPages;    // Pages the atlas has grown to.
+} NR_Font_Stats;
+
 // Init / shutdown font stuff.
 bool NR_Font_Init();
 void NR_Font_Shutdown();
 
-// Load / Destroy fonts.
-NR_Font NR_Font_Load(const char* path);
+// Set where rendered atlases are cached between runs, or null to not cache them. Defaults to the
+// user's cache directory.
+void NR_Font_SetCacheDirectory(const char* path);
+
+// Load / Destroy fonts. The font draws with the given renderer, which must outlive it.
+NR_Font NR_Font_Load(NR_Renderer renderer, const char* path);
+
+// Load a font with count - 1 fonts to fall back on, in order, for glyphs the first doesn't have. Each can be a
+// file or a font descriptor, as for NR_Font_Load. Cells are sized and laid out by the first.
+NR_Font NR_Font_LoadWithFallbacks(NR_Renderer renderer, const char* const* paths, unsigned int count);
 void NR_Font_Delete(NR_Font font);
 
 // Set the font resolution. (The resolution of a character on the underlying texture page.)
+// Glyphs rendered at other resolutions are kept, so changing back doesn't render them again.
 void NR_Font_SetResolution(NR_Font font, int width, int height);
 
+// Choose how glyphs are rendered. Glyphs rendered the other way are kept, for if it changes back.
+void NR_Font_SetRaster(NR_Font font, NR_Font_Raster raster);
+NR_Font_Raster NR_Font_GetRaster(NR_Font font);
+
 // Set the size of a character when drawn (pixels). Leave height or width to 0 to be automatically set based on the aspect ratio.
 void NR_Font_SetSize(NR_Font font, int width, int height);
 void NR_Font_GetSize(NR_Font font, int* width, int* height);
 
-// Draw a grid of characters
+// Choose whether glyph colours are packed RGBA or palette indices.
+void NR_Font_SetColorMode(NR_Font font, NR_ColorMode mode);
+
+// Set count palette entries (packed RGBA) starting at start.
+void NR_Font_SetPalette(NR_Font font, unsigned int start, unsigned int count, const unsigned int* colors);
+
+// Set how much GPU memory the atlas can grow to, in bytes. Once it's full, the glyphs on the page used longest
+// ago are thrown out to make room, and rendered again if they're drawn again. Defaults to 16MB.
+void NR_Font_SetAtlasBudget(NR_Font font, unsigned int bytes);
+
+// Render and pack every glyph in count codepoint ranges in the background, so they're ready before they're
+// first drawn. The ranges are kept and rendered again if the resolution changes. This grows and evicts atlas
+// pages like NR_Font_Draw does, so don't call it while another thread might be drawing with the font.
+void NR_Font_Prewarm(NR_Font font, const NR_Codepoint_Range* ranges, unsigned int count);
+
+// Choose which pipeline to draw with. Can be changed between draws.
+void NR_Font_SetPipeline(NR_Font font, NR_Font_Pipeline pipeline);
+NR_Font_Pipeline NR_Font_GetPipeline(NR_Font font);
+
+// Draw a grid of characters. Only cells that have changed since the last draw are rebuilt and uploaded.
+// Glyphs not seen before are rendered in the background, their cells are drawn with only a background
+// until they're ready.
 bool NR_Font_Draw(NR_Font font, NR_Glyph* data, int dataWidth, int dataHeight, int x, int y, int width, int height);
 
+// Block until every glyph asked for so far has been rendered. They're added on the next draw.
+void NR_Font_WaitForGlyphs(NR_Font font);
+
+// Get how much work the last draw took.
+void NR_Font_GetStats(NR_Font font, NR_Font_Stats* stats);
+
 #endif
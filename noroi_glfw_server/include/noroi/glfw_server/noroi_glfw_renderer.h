@@ -0,0 +1,64 @@
+#ifndef NOROI_GLFW_RENDERER_INCLUDED
+#define NOROI_GLFW_RENDERER_INCLUDED
+
+#include <glad/glad.h>
+
+#include <stdbool.h>
+
+// Renderer state, one per opengl context. Owns the shader programs, and tracks what's
+// bound so that redundant state changes can be skipped.
+typedef void* NR_Renderer;
+
+// The shader programs the renderer provides.
+typedef enum {
+  NR_RENDERER_PROGRAM_GEOMETRY,     // A point per cell, expanded by a geometry shader.
+  NR_RENDERER_PROGRAM_INSTANCED,    // An instanced pair of quads per cell.
+  NR_RENDERER_PROGRAM_GRID_TEXTURE, // One quad for the whole grid, reading cells from a texture.
+
+  NR_RENDERER_PROGRAM_COUNT
+} NR_Renderer_Program;
+
+// Attribute locations, the same in every program.
+typedef enum {
+  NR_RENDERER_ATTRIB_CELL,
+  NR_RENDERER_ATTRIB_GLYPH,
+  NR_RENDERER_ATTRIB_COLOR,
+  NR_RENDERER_ATTRIB_BG_COLOR
+} NR_Renderer_Attrib;
+
+// Texture units.
+#define NR_RENDERER_ATLAS_UNIT 0   // GL_TEXTURE_2D_ARRAY of glyph pages.
+#define NR_RENDERER_GLYPHS_UNIT 1  // GL_TEXTURE_BUFFER of glyph metrics.
+#define NR_RENDERER_CELLS_UNIT 2   // GL_TEXTURE_2D (RGBA32UI) of cells, one texel each.
+#define NR_RENDERER_UNIT_COUNT 3
+
+// Uniform buffer binding points.
+#define NR_RENDERER_PALETTE_BINDING 0
+#define NR_RENDERER_FRAME_BINDING 1
+
+// Create / delete a renderer for the current context.
+NR_Renderer NR_Renderer_New();
+void NR_Renderer_Delete(NR_Renderer renderer);
+
+// Start drawing to a target of width x height. The projection is only rebuilt when the size changes.
+void NR_Renderer_Begin(NR_Renderer renderer, int width, int height);
+
+// Bind things, doing nothing if they're already bound.
+void NR_Renderer_UseProgram(NR_Renderer renderer, NR_Renderer_Program program);
+void NR_Renderer_BindVertexArray(NR_Renderer renderer, GLuint vao);
+void NR_Renderer_BindTexture(NR_Renderer renderer, GLuint unit, GLenum target, GLuint texture); // Leaves unit active.
+void NR_Renderer_BindUniformBuffer(NR_Renderer renderer, GLuint binding, GLuint buffer);
+
+// Set whether the current program reads colours as palette indices.
+void NR_Renderer_SetPaletteMode(NR_Renderer renderer, bool paletteMode);
+
+// Set where the current program's grid starts and the size of a cell, in pixels.
+void NR_Renderer_SetGrid(NR_Renderer renderer, float x, float y, float cellWidth, float cellHeight);
+
+// A vertex array with no attributes, for geometry made up in the vertex shader.
+GLuint NR_Renderer_GetEmptyVertexArray(NR_Renderer renderer);
+
+// Forget what's bound, for when something else has changed the opengl state.
+void NR_Renderer_Invalidate(NR_Renderer renderer);
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef NOROI_GLYPH_RASTERIZER_INCLUDED
+#define NOROI_GLYPH_RASTERIZER_INCLUDED
+
+#include <stdbool.h>
+
+// Renders glyphs with freetype on a worker thread, with its own face, so that drawing
+// never has to wait for a glyph to be rasterised.
+typedef void* NR_GlyphRasterizer;
+
+// Styles made from the font's regular outlines. Combine them with |.
+typedef enum {
+  NR_GLYPH_STYLE_REGULAR = 0,
+  NR_GLYPH_STYLE_BOLD = 1,
+  NR_GLYPH_STYLE_ITALIC = 2
+} NR_GlyphStyle;
+
+// How far signed distance fields reach either side of a glyph's edge, in pixels. Each field is padded by
+// this much, and 8 bit values step by 1 / (2 * spread) per pixel, with the edge at 0.5.
+#define NR_GLYPH_DISTANCE_SPREAD 8
+
+// Which glyph to render. Sizes are in pixels, as for FT_Set_Pixel_Sizes.
+typedef struct {
+  unsigned int codepoint;
+  int width, height;
+  unsigned int style;
+  bool distanceField; // A signed distance field rather than coverage, see NR_GlyphRasterizer_HasDistanceFields.
+} NR_GlyphRasterizer_Key;
+
+// A rendered glyph.
+typedef struct {
+  NR_GlyphRasterizer_Key key;
+  bool rendered; // False if freetype couldn't render it.
+
+  unsigned int width, height;
+  int bearingX, bearingY;
+  unsigned int advance;
+
+  // width * height 8 bit coverage or distance values, owned by the glyph.
+  unsigned char* bitmap;
+} NR_GlyphRasterizer_Glyph;
+
+// A font to render from: the file at path, or size bytes of font data if data isn't null. The data must
+// outlive the rasterizer.
+typedef struct {
+  const char* path;
+  const unsigned char* data;
+  unsigned int size;
+} NR_GlyphRasterizer_Source;
+
+// Create a rasterizer for count fonts. Each glyph comes from the first that has it, the first font's
+// missing glyph is used if none do.
+NR_GlyphRasterizer NR_GlyphRasterizer_New(const NR_GlyphRasterizer_Source* sources, unsigned int count);
+void NR_GlyphRasterizer_Delete(NR_GlyphRasterizer rasterizer);
+
+// Whether distance fields can be rendered, which needs freetype 2.11 or later. Without them, glyphs asked
+// for as distance fields come back as coverage.
+bool NR_GlyphRasterizer_HasDistanceFields();
+
+// Whether any of the fonts has a glyph for a codepoint. Safe to call from any thread.
+bool NR_GlyphRasterizer_HasGlyph(NR_GlyphRasterizer rasterizer, unsigned int codepoint);
+
+// Drop glyphs waiting to be rendered at any other size or kind, when they're no longer wanted first.
+void NR_GlyphRasterizer_CancelOtherSizes(NR_GlyphRasterizer rasterizer, int width, int height, bool distanceField);
+
+// Ask for a glyph to be rendered. Returns false if it's already been tried and couldn't be,
+// asking again for a glyph that's on its way does nothing.
+bool NR_GlyphRasterizer_Request(NR_GlyphRasterizer rasterizer, const NR_GlyphRasterizer_Key* key);
+
+// Forget a glyph has been rendered, once it's been thrown away, so asking for it again renders it again.
+void NR_GlyphRasterizer_Forget(NR_GlyphRasterizer rasterizer, const NR_GlyphRasterizer_Key* key);
+
+// Give up on a rendered glyph that couldn't be used, so asking for it again returns false rather than rendering it again.
+void NR_GlyphRasterizer_MarkFailed(NR_GlyphRasterizer rasterizer, const NR_GlyphRasterizer_Key* key);
+
+// Take a rendered glyph, if there are any. Free it with NR_GlyphRasterizer_FreeGlyph.
+bool NR_GlyphRasterizer_Receive(NR_GlyphRasterizer rasterizer, NR_GlyphRasterizer_Glyph* glyph);
+void NR_GlyphRasterizer_FreeGlyph(NR_GlyphRasterizer_Glyph* glyph);
+
+// Block until every requested glyph has been rendered.
+void NR_GlyphRasterizer_Wait(NR_GlyphRasterizer rasterizer);
+
+#endif
@@ -5,7 +5,10 @@
 
 // Glyph type.
 typedef struct {
+  // Glyphs are found by codepoint and variant. The variant's left to the user, e.g. for different
+  // sizes or styles of the same codepoint.
   unsigned int codepoint;
+  unsigned int variant;
   unsigned int x;
   unsigned int y;
   unsigned int width;
@@ -15,15 +18,43 @@ typedef struct {
   int bearingX;
   int bearingY;
   unsigned int advance;
+
+  // Left to the user, e.g. an index into their own per-glyph data.
+  unsigned int index;
+
+  // Where the glyph sits in a cell, as fractions of the cell size (left, top, width, height).
+  float quad[4];
+
+  // Where the glyph is on its page, in texture coordinates (left, top, right, bottom).
+  // Filled in by the packer when the glyph is added.
+  float uv[4];
 } NR_GlyphPacker_Glyph;
 
+// How glyphs are placed on a page.
+typedef enum {
+  NR_GLYPHPACKER_METHOD_SKYLINE, // Stacked along the outline of what's packed so far. Suits glyphs of similar heights.
+  NR_GLYPHPACKER_METHOD_TREE     // Splitting free space into a binary tree of rects.
+} NR_GlyphPacker_Method;
+
 // Handle
 typedef void* NR_GlyphPacker;
 
+// Create a packer for pages of width * height, with maxPage to start with. Packs with the skyline method
+// unless told otherwise.
 NR_GlyphPacker* NR_GlyphPacker_New(int width, int height, int maxPage);
+NR_GlyphPacker* NR_GlyphPacker_NewWithMethod(int width, int height, int maxPage, NR_GlyphPacker_Method method);
 void NR_GlyphPacker_Delete(NR_GlyphPacker* packer);
 
+// Add a glyph to the first page with room for it, or to one page. False if there's no room.
 bool NR_GlyphPacker_Add(NR_GlyphPacker* packer, const NR_GlyphPacker_Glyph* glyph);
-bool NR_GlyphPacker_Find(NR_GlyphPacker* packer, unsigned int codepoint, NR_GlyphPacker_Glyph* glyph);
+bool NR_GlyphPacker_AddToPage(NR_GlyphPacker* packer, const NR_GlyphPacker_Glyph* glyph, unsigned int page);
+bool NR_GlyphPacker_Find(NR_GlyphPacker* packer, unsigned int codepoint, unsigned int variant, NR_GlyphPacker_Glyph* glyph);
+
+// Add empty pages, up to count. Pages are never taken away.
+unsigned int NR_GlyphPacker_GetPageCount(NR_GlyphPacker* packer);
+void NR_GlyphPacker_SetPageCount(NR_GlyphPacker* packer, unsigned int count);
+
+// Remove every glyph on a page, leaving it empty.
+void NR_GlyphPacker_ClearPage(NR_GlyphPacker* packer, unsigned int page);
 
 #endif
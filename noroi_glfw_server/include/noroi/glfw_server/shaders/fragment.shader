@@ -1,17 +1,29 @@
 #version 330 core
 
+// How far distance fields reach either side of an edge, in texels (NR_GLYPH_DISTANCE_SPREAD).
+#define DISTANCE_SPREAD 8.0
+
 in vec3 fColor;
-in vec2 fTextureCoord;
+in vec3 fTextureCoord;
+in float fDistanceField;
 
-uniform sampler2D sampler;
-uniform mat4 proj;
+uniform sampler2DArray sampler;
 
 out vec4 oColor;
 
 void main() {
+  // How many atlas texels this pixel covers. Worked out before branching, where derivatives are still defined.
+  vec2 texels = fwidth(fTextureCoord.xy) * vec2(textureSize(sampler, 0).xy);
+
   // Get the texture color.
   oColor = vec4(fColor.x, fColor.y, fColor.z, 1.0);
   if (fTextureCoord.x >= 0.0) {
     oColor.w = texture(sampler, fTextureCoord).r;
+
+    // Distance fields have their edge at 0.5. Smooth it over a pixel, whatever size it's drawn at.
+    if (fDistanceField > 0.5) {
+      float pixel = max((texels.x + texels.y) / (4.0 * DISTANCE_SPREAD), 0.001);
+      oColor.w = smoothstep(0.5 - pixel * 0.5, 0.5 + pixel * 0.5, oColor.w);
+    }
   }
 }
@@ -8,31 +8,40 @@ layout(triangle_strip, max_vertices = 8) out;
 
 #define FLASH_PERIOD float(0.3)
 
+#define NO_PAGE uint(0xFF)
+
 in vec3 gColor[];
 in vec3 gBgColor[];
 in vec4 gGlyphRect[];
 in vec4 gTextureRect[];
 in vec4 gBgRect[];
 in uint gFlags[];
+in uint gPage[];
+in float gDistanceField[];
 
-uniform sampler2D sampler;
-uniform mat4 proj;
-uniform float timer;
+// Projection and timer, shared by every program.
+layout(std140, row_major) uniform Frame {
+  mat4 proj;
+  float timer;
+};
 
 out vec3 fColor;
-out vec2 fTextureCoord;
+out vec3 fTextureCoord;
+out float fDistanceField;
 
 void emitBGVertex(vec2 position, vec3 color) {
   gl_Position = vec4(position, 0, 1);
   fColor = color;
-  fTextureCoord = vec2(-1.0, -1.0);
+  fTextureCoord = vec3(-1.0, -1.0, 0.0);
+  fDistanceField = 0.0;
   EmitVertex();
 }
 
 void emitGlyphVertex(vec2 position, vec3 color, vec2 texCoord) {
   gl_Position = vec4(position, 0, 1);
   fColor = color;
-  fTextureCoord = texCoord;
+  fTextureCoord = vec3(texCoord, float(gPage[0]));
+  fDistanceField = gDistanceField[0];
   EmitVertex();
 }
 
@@ -50,8 +59,8 @@ void main() {
   emitBGVertex(gBgRect[0].zw, gBgColor[0]);
   EndPrimitive();
 
-  // Create the rect for the actual glyph.
-  if (drawGlyph) {
+  // Create the rect for the actual glyph, if it has one.
+  if (drawGlyph && gPage[0] != NO_PAGE) {
     emitGlyphVertex(gGlyphRect[0].xy, gColor[0], gTextureRect[0].xy);
     emitGlyphVertex(gGlyphRect[0].zy, gColor[0], gTextureRect[0].zy);
     emitGlyphVertex(gGlyphRect[0].xw, gColor[0], gTextureRect[0].xw);
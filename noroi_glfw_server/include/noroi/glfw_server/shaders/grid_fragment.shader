@@ -0,0 +1,99 @@
+#version 330 core
+
+#define FLAG_FLASHING uint(1)
+#define FLAG_ITALIC uint(2)
+#define FLAG_BOLD uint(4)
+
+#define FLASH_PERIOD float(0.3)
+
+// How far distance fields reach either side of an edge, in texels (NR_GLYPH_DISTANCE_SPREAD).
+#define DISTANCE_SPREAD 8.0
+
+#define GLYPH_MASK uint(0xFFFFFF)
+#define NO_GLYPH GLYPH_MASK
+
+in vec2 fPosition;
+
+out vec4 oColor;
+
+// Projection and timer, shared by every program.
+layout(std140, row_major) uniform Frame {
+  mat4 proj;
+  float timer;
+};
+
+// Where the grid starts and the size of a cell (x, y, width, height), in pixels.
+uniform vec4 grid;
+
+// One texel per cell: position, glyph (flags in the top 8 bits), color, background color.
+uniform usampler2D cells;
+
+// Metrics for each glyph, three texels each: its quad in a cell, its UV rect, and its page and whether
+// it's a distance field.
+uniform samplerBuffer glyphs;
+
+// The atlas.
+uniform sampler2DArray sampler;
+
+// 256 packed RGBA colours, four to each uvec4.
+uniform bool paletteMode;
+layout(std140) uniform Palette {
+  uvec4 palette[64];
+};
+
+vec3 unpackColor(uint color) {
+  // In palette mode the colour is just an index into the palette.
+  if (paletteMode) {
+    uint index = color & uint(0xFF);
+    color = palette[index >> 2][index & uint(3)];
+  }
+
+  return vec3((color >> 24) & uint(0xFF), (color >> 16) & uint(0xFF), (color >> 8) & uint(0xFF)) / 255.0;
+}
+
+void main() {
+  // Find the cell we're in.
+  ivec2 cell = clamp(ivec2(floor((fPosition - grid.xy) / grid.zw)), ivec2(0), textureSize(cells, 0) - 1);
+  uvec4 data = texelFetch(cells, cell, 0);
+
+  // Start with the background.
+  vec3 color = unpackColor(data.w);
+
+  // Flags live in the top 8 bits of the glyph.
+  uint glyph = data.y & GLYPH_MASK;
+  uint flags = data.y >> 24;
+
+  // Flash every 0.3 seconds.
+  float periods = timer / FLASH_PERIOD;
+  bool flashPeriod = mod(periods, 2) > 1;
+  bool flashingCharacter = (flags & FLAG_FLASHING) == FLAG_FLASHING;
+  bool drawGlyph = !flashingCharacter || (flashPeriod && flashingCharacter);
+
+  if (drawGlyph && glyph != NO_GLYPH) {
+    // Where the glyph sits in the cell.
+    int index = int(glyph) * 3;
+    vec4 quad = texelFetch(glyphs, index);
+    vec2 start = grid.xy + (vec2(cell) + quad.xy) * grid.zw;
+    vec2 end = start + quad.zw * grid.zw;
+
+    // Blend the glyph over the background if we're inside it.
+    vec2 t = (fPosition - start) / (end - start);
+    if (all(greaterThanEqual(t, vec2(0.0))) && all(lessThan(t, vec2(1.0)))) {
+      vec4 uv = texelFetch(glyphs, index + 1);
+      vec4 info = texelFetch(glyphs, index + 2);
+      float alpha = texture(sampler, vec3(mix(uv.xy, uv.zw, t), info.x)).r;
+
+      // Distance fields have their edge at 0.5. Smooth it over a pixel, whatever size it's drawn at. The
+      // glyph's size on screen says how many texels a pixel covers, without derivatives in a branch.
+      if (info.y > 0.5) {
+        vec2 texels = (uv.zw - uv.xy) * vec2(textureSize(sampler, 0).xy) / (end - start);
+        float pixel = max((texels.x + texels.y) / (4.0 * DISTANCE_SPREAD), 0.001);
+        alpha = smoothstep(0.5 - pixel * 0.5, 0.5 + pixel * 0.5, alpha);
+      }
+
+      color = mix(color, unpackColor(data.z), alpha);
+    }
+  }
+
+  oColor = vec4(color, 1.0);
+}
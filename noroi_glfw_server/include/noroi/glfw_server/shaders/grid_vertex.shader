@@ -0,0 +1,26 @@
+#version 330 core
+
+// Draws one quad covering the whole grid. The fragment shader looks up the cell under each pixel.
+
+out vec2 fPosition;
+
+// Projection and timer, shared by every program.
+layout(std140, row_major) uniform Frame {
+  mat4 proj;
+  float timer;
+};
+
+// Where the grid starts and the size of a cell (x, y, width, height), in pixels.
+uniform vec4 grid;
+
+// One texel per cell.
+uniform usampler2D cells;
+
+void main() {
+  // Which corner of the quad this is, in triangle strip order.
+  vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+
+  // Position in pixels, for the fragment shader to find its cell from.
+  fPosition = grid.xy + corner * grid.zw * vec2(textureSize(cells, 0));
+  gl_Position = proj * vec4(fPosition, 0.0, 1.0);
+}
@@ -0,0 +1,105 @@
+#version 330 core
+
+// Draws each cell as an instance of two quads (background then glyph), rather than expanding points
+// in a geometry shader.
+
+#define FLAG_FLASHING uint(1)
+#define FLAG_ITALIC uint(2)
+#define FLAG_BOLD uint(4)
+
+#define FLASH_PERIOD float(0.3)
+
+// Per instance.
+in uvec2 vCell;
+in uint vGlyph;
+in uint vColor;
+in uint vBgColor;
+
+out vec3 fColor;
+out vec3 fTextureCoord;
+out float fDistanceField;
+
+// Projection and timer, shared by every program.
+layout(std140, row_major) uniform Frame {
+  mat4 proj;
+  float timer;
+};
+
+// Where the grid starts and the size of a cell (x, y, width, height), in pixels.
+uniform vec4 grid;
+
+// Metrics for each glyph, three texels each: its quad in a cell, its UV rect, and its page and whether
+// it's a distance field.
+uniform samplerBuffer glyphs;
+
+#define GLYPH_MASK uint(0xFFFFFF)
+#define NO_GLYPH GLYPH_MASK
+
+// 256 packed RGBA colours, four to each uvec4.
+uniform bool paletteMode;
+layout(std140) uniform Palette {
+  uvec4 palette[64];
+};
+
+vec3 unpackColor(uint color) {
+  // In palette mode the colour is just an index into the palette.
+  if (paletteMode) {
+    uint index = color & uint(0xFF);
+    color = palette[index >> 2][index & uint(3)];
+  }
+
+  return vec3((color >> 24) & uint(0xFF), (color >> 16) & uint(0xFF), (color >> 8) & uint(0xFF)) / 255.0;
+}
+
+// The corners of a quad made of two triangles.
+const vec2 corners[6] = vec2[](vec2(0, 0), vec2(1, 0), vec2(0, 1),
+                               vec2(0, 1), vec2(1, 0), vec2(1, 1));
+
+void main() {
+  // The first six vertices are the background, the next six the glyph.
+  vec2 corner = corners[gl_VertexID % 6];
+  vec2 cell = vec2(vCell);
+
+  if (gl_VertexID < 6) {
+    vec4 bgRect = vec4(grid.xy + grid.zw * cell, grid.xy + grid.zw * (cell + 1.0));
+    gl_Position = proj * vec4(mix(bgRect.xy, bgRect.zw, corner), 0.0, 1.0);
+    fColor = unpackColor(vBgColor);
+    fTextureCoord = vec3(-1.0, -1.0, 0.0);
+    fDistanceField = 0.0;
+    return;
+  }
+
+  // Flags live in the top 8 bits of the glyph.
+  uint glyph = vGlyph & GLYPH_MASK;
+  uint flags = vGlyph >> 24;
+
+  // Flash every 0.3 seconds.
+  float periods = timer / FLASH_PERIOD;
+  bool flashPeriod = mod(periods, 2) > 1;
+  bool flashingCharacter = (flags & FLAG_FLASHING) == FLAG_FLASHING;
+  bool drawGlyph = !flashingCharacter || (flashPeriod && flashingCharacter);
+
+  // Collapse the quad if there's no glyph to draw.
+  if (!drawGlyph || glyph == NO_GLYPH) {
+    gl_Position = vec4(-2.0, -2.0, 0.0, 1.0);
+    fColor = vec3(0.0);
+    fTextureCoord = vec3(-1.0, -1.0, 0.0);
+    fDistanceField = 0.0;
+    return;
+  }
+
+  // The glyph sits in the cell according to its metrics.
+  int index = int(glyph) * 3;
+  vec4 quad = texelFetch(glyphs, index);
+  vec4 uv = texelFetch(glyphs, index + 1);
+  vec4 info = texelFetch(glyphs, index + 2);
+
+  vec4 glyphRect;
+  glyphRect.xy = grid.xy + (cell + quad.xy) * grid.zw;
+  glyphRect.zw = glyphRect.xy + quad.zw * grid.zw;
+
+  gl_Position = proj * vec4(mix(glyphRect.xy, glyphRect.zw, corner), 0.0, 1.0);
+  fColor = unpackColor(vColor);
+  fTextureCoord = vec3(mix(uv.xy, uv.zw, corner), info.x);
+  fDistanceField = info.y;
+}
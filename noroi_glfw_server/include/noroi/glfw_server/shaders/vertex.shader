@@ -1,11 +1,9 @@
 #version 330 core
 
-in vec3 vColor;
-in vec3 vBgColor;
-in vec4 vGlyphRect;
-in vec4 vTextureRect;
-in vec4 vBgRect;
-in uint vFlags;
+in uvec2 vCell;
+in uint vGlyph;
+in uint vColor;
+in uint vBgColor;
 
 out vec3 gColor;
 out vec3 gBgColor;
@@ -13,24 +11,76 @@ out vec4 gGlyphRect;
 out vec4 gTextureRect;
 out vec4 gBgRect;
 out uint gFlags;
+out uint gPage;
+out float gDistanceField;
 
-uniform sampler2D sampler;
-uniform mat4 proj;
+// Projection and timer, shared by every program.
+layout(std140, row_major) uniform Frame {
+  mat4 proj;
+  float timer;
+};
+
+// Where the grid starts and the size of a cell (x, y, width, height), in pixels.
+uniform vec4 grid;
+
+// Metrics for each glyph, three texels each: its quad in a cell, its UV rect, and its page and whether
+// it's a distance field.
+uniform samplerBuffer glyphs;
+
+#define GLYPH_MASK uint(0xFFFFFF)
+#define NO_GLYPH GLYPH_MASK
+
+#define NO_PAGE uint(0xFF)
+
+// 256 packed RGBA colours, four to each uvec4.
+uniform bool paletteMode;
+layout(std140) uniform Palette {
+  uvec4 palette[64];
+};
+
+vec3 unpackColor(uint color) {
+  // In palette mode the colour is just an index into the palette.
+  if (paletteMode) {
+    uint index = color & uint(0xFF);
+    color = palette[index >> 2][index & uint(3)];
+  }
+
+  return vec3((color >> 24) & uint(0xFF), (color >> 16) & uint(0xFF), (color >> 8) & uint(0xFF)) / 255.0;
+}
 
 void main() {
-  // Pass colors through
-  gColor = vColor;
-  gBgColor = vBgColor;
+  // Unpack colors
+  gColor = unpackColor(vColor);
+  gBgColor = unpackColor(vBgColor);
+
+  // Flags live in the top 8 bits of the glyph.
+  uint glyph = vGlyph & GLYPH_MASK;
+  gFlags = vGlyph >> 24;
+
+  // The background fills the cell.
+  vec2 cell = vec2(vCell);
+  vec4 bgRect = vec4(grid.xy + grid.zw * cell, grid.xy + grid.zw * (cell + 1.0));
 
-  // Pass flags through too.
-  gFlags = vFlags;
+  // The glyph sits in the cell according to its metrics.
+  vec4 glyphRect = vec4(0.0);
+  gTextureRect = vec4(0.0);
+  gPage = NO_PAGE;
+  gDistanceField = 0.0;
+  if (glyph != NO_GLYPH) {
+    int index = int(glyph) * 3;
+    vec4 quad = texelFetch(glyphs, index);
+    gTextureRect = texelFetch(glyphs, index + 1);
+    vec4 info = texelFetch(glyphs, index + 2);
+    gPage = uint(info.x);
+    gDistanceField = info.y;
 
-  // Pass texture rect straight through.
-  gTextureRect = vTextureRect;
+    glyphRect.xy = grid.xy + (cell + quad.xy) * grid.zw;
+    glyphRect.zw = glyphRect.xy + quad.zw * grid.zw;
+  }
 
-  // Transform input rectangles by our projection matrix.
-  gGlyphRect.xy = (proj * vec4(vGlyphRect.x, vGlyphRect.y, 0.0, 1.0)).xy;
-  gGlyphRect.zw = (proj * vec4(vGlyphRect.z, vGlyphRect.w, 0.0, 1.0)).xy;
-  gBgRect.xy = (proj * vec4(vBgRect.x, vBgRect.y, 0.0, 1.0)).xy;
-  gBgRect.zw = (proj * vec4(vBgRect.z, vBgRect.w, 0.0, 1.0)).xy;
+  // Transform rectangles by our projection matrix.
+  gGlyphRect.xy = (proj * vec4(glyphRect.x, glyphRect.y, 0.0, 1.0)).xy;
+  gGlyphRect.zw = (proj * vec4(glyphRect.z, glyphRect.w, 0.0, 1.0)).xy;
+  gBgRect.xy = (proj * vec4(bgRect.x, bgRect.y, 0.0, 1.0)).xy;
+  gBgRect.zw = (proj * vec4(bgRect.z, bgRect.w, 0.0, 1.0)).xy;
 }
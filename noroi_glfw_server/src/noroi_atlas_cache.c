@@ -0,0 +1,244 @@
+#include <noroi/glfw_server/noroi_atlas_cache.h>
+
+#include <noroi/glfw_server/noroi_file.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CACHE_MAGIC "NRAC"
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+// The start of a cache file. Followed by glyphCount CacheGlyphs, then a checksum for each page, then pageCount pages.
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint64_t fontHash;
+  uint32_t pageWidth, pageHeight;
+  uint32_t glyphCount, pageCount;
+  uint64_t checksum; // Of the header, with this zeroed, the glyphs and the page checksums.
+} CacheHeader;
+
+// A glyph as it's stored in a cache file.
+typedef struct {
+  uint32_t codepoint;
+  int32_t pixelWidth, pixelHeight;
+  uint32_t style, distanceField;
+  uint32_t x, y, width, height, page;
+  int32_t bearingX, bearingY;
+  uint32_t advance;
+  float quad[4];
+  float uv[4];
+} CacheGlyph;
+
+// Internal representation of NR_AtlasCache
+typedef struct {
+  NR_File_Mapping mapping;
+  CacheHeader header;
+  const unsigned char* glyphs;
+  const unsigned char* pageChecksums;
+  const unsigned char* pages;
+} HandleType;
+
+static uint64_t _hash(const void* data, size_t size, uint64_t hash) {
+  const unsigned char* bytes = (const unsigned char*)data;
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= FNV_PRIME;
+  }
+
+  return hash;
+}
+
+uint64_t NR_AtlasCache_Hash(const void* data, size_t size) {
+  return _hash(data, size, FNV_OFFSET_BASIS);
+}
+
+// Start the checksum of a file with its header.
+static uint64_t _hashHeader(const CacheHeader* header) {
+  CacheHeader unchecked = *header;
+  unchecked.checksum = 0;
+  return _hash(&unchecked, sizeof(CacheHeader), FNV_OFFSET_BASIS);
+}
+
+NR_AtlasCache NR_AtlasCache_Open(const char* path, const NR_AtlasCache_Key* key) {
+  NR_File_Mapping mapping;
+  if (!NR_File_Map(path, &mapping))
+    return (void*)0;
+
+  // Check it's a cache made for this font and page size, by this version.
+  CacheHeader header;
+  bool valid = mapping.size >= sizeof(CacheHeader);
+  if (valid) {
+    memcpy(&header, mapping.data, sizeof(CacheHeader));
+    valid = memcmp(header.magic, CACHE_MAGIC, 4) == 0 && header.version == NR_ATLAS_CACHE_VERSION &&
+            header.fontHash == key->fontHash && header.pageWidth == key->pageWidth && header.pageHeight == key->pageHeight;
+  }
+
+  // Check it's all there, and the glyphs haven't been damaged.
+  uint64_t glyphsSize = (uint64_t)header.glyphCount * sizeof(CacheGlyph) + (uint64_t)header.pageCount * sizeof(uint64_t);
+  if (valid) {
+    uint64_t pageSize = (uint64_t)header.pageWidth * header.pageHeight;
+    uint64_t size = sizeof(CacheHeader) + glyphsSize + (uint64_t)header.pageCount * pageSize;
+    valid = size == mapping.size &&
+            _hash(mapping.data + sizeof(CacheHeader), (size_t)glyphsSize, _hashHeader(&header)) == header.checksum;
+  }
+
+  if (!valid) {
+    NR_File_Unmap(&mapping);
+    return (void*)0;
+  }
+
+  HandleType* hnd = malloc(sizeof(HandleType));
+  hnd->mapping = mapping;
+  hnd->header = header;
+  hnd->glyphs = mapping.data + sizeof(CacheHeader);
+  hnd->pageChecksums = hnd->glyphs + header.glyphCount * sizeof(CacheGlyph);
+  hnd->pages = hnd->pageChecksums + header.pageCount * sizeof(uint64_t);
+
+  return (void*)hnd;
+}
+
+void NR_AtlasCache_Close(NR_AtlasCache cache) {
+  HandleType* hnd = (HandleType*)cache;
+  NR_File_Unmap(&hnd->mapping);
+  free(hnd);
+}
+
+unsigned int NR_AtlasCache_GetGlyphCount(NR_AtlasCache cache) {
+  HandleType* hnd = (HandleType*)cache;
+  return hnd->header.glyphCount;
+}
+
+void NR_AtlasCache_GetGlyph(NR_AtlasCache cache, unsigned int i, NR_AtlasCache_Glyph* cached) {
+  HandleType* hnd = (HandleType*)cache;
+
+  // The mapping's only aligned to the start of the file, so copy it out.
+  CacheGlyph stored;
+  memcpy(&stored, hnd->glyphs + i * sizeof(CacheGlyph), sizeof(CacheGlyph));
+
+  memset(cached, 0, sizeof(NR_AtlasCache_Glyph));
+  cached->pixelWidth = stored.pixelWidth;
+  cached->pixelHeight = stored.pixelHeight;
+  cached->style = stored.style;
+  cached->distanceField = stored.distanceField != 0;
+
+  NR_GlyphPacker_Glyph* glyph = &cached->glyph;
+  glyph->codepoint = stored.codepoint;
+  glyph->x = stored.x;
+  glyph->y = stored.y;
+  glyph->width = stored.width;
+  glyph->height = stored.height;
+  glyph->page = stored.page;
+  glyph->bearingX = stored.bearingX;
+  glyph->bearingY = stored.bearingY;
+  glyph->advance = stored.advance;
+  memcpy(glyph->quad, stored.quad, sizeof(glyph->quad));
+  memcpy(glyph->uv, stored.uv, sizeof(glyph->uv));
+}
+
+unsigned int NR_AtlasCache_GetPageCount(NR_AtlasCache cache) {
+  HandleType* hnd = (HandleType*)cache;
+  return hnd->header.pageCount;
+}
+
+bool NR_AtlasCache_CopyPage(NR_AtlasCache cache, unsigned int page, unsigned char* pixels) {
+  HandleType* hnd = (HandleType*)cache;
+
+  // Check the copy, rather than reading the mapping twice.
+  size_t pageSize = (size_t)hnd->header.pageWidth * hnd->header.pageHeight;
+  memcpy(pixels, hnd->pages + page * pageSize, pageSize);
+
+  uint64_t checksum;
+  memcpy(&checksum, hnd->pageChecksums + page * sizeof(uint64_t), sizeof(uint64_t));
+  return NR_AtlasCache_Hash(pixels, pageSize) == checksum;
+}
+
+// Write data to a file, adding it to the checksum.
+static bool _write(FILE* file, const void* data, size_t size, uint64_t* checksum) {
+  *checksum = _hash(data, size, *checksum);
+  return fwrite(data, 1, size, file) == size;
+}
+
+bool NR_AtlasCache_Save(const char* path, const NR_AtlasCache_Key* key, const NR_AtlasCache_Glyph* glyphs, unsigned int glyphCount,
+                        unsigned char* const* pages, unsigned int pageCount) {
+  // Write to a temporary file first, and only replace the real one once it's complete.
+  size_t pathLength = strlen(path);
+  char* tempPath = malloc(pathLength + 5);
+  memcpy(tempPath, path, pathLength);
+  memcpy(tempPath + pathLength, ".tmp", 5);
+
+  FILE* file = fopen(tempPath, "wb");
+  if (!file) {
+    free(tempPath);
+    return false;
+  }
+
+  CacheHeader header;
+  memset(&header, 0, sizeof(CacheHeader));
+  memcpy(header.magic, CACHE_MAGIC, 4);
+  header.version = NR_ATLAS_CACHE_VERSION;
+  header.fontHash = key->fontHash;
+  header.pageWidth = key->pageWidth;
+  header.pageHeight = key->pageHeight;
+  header.glyphCount = glyphCount;
+  header.pageCount = pageCount;
+  header.checksum = _hashHeader(&header);
+
+  // Leave room for the header, it's written last once we have the checksum.
+  bool written = fwrite(&header, sizeof(CacheHeader), 1, file) == 1;
+
+  for (unsigned int i = 0; i < glyphCount && written; ++i) {
+    const NR_GlyphPacker_Glyph* glyph = &glyphs[i].glyph;
+    CacheGlyph stored;
+    memset(&stored, 0, sizeof(CacheGlyph));
+    stored.codepoint = glyph->codepoint;
+    stored.pixelWidth = glyphs[i].pixelWidth;
+    stored.pixelHeight = glyphs[i].pixelHeight;
+    stored.style = glyphs[i].style;
+    stored.distanceField = glyphs[i].distanceField;
+    stored.x = glyph->x;
+    stored.y = glyph->y;
+    stored.width = glyph->width;
+    stored.height = glyph->height;
+    stored.page = glyph->page;
+    stored.bearingX = glyph->bearingX;
+    stored.bearingY = glyph->bearingY;
+    stored.advance = glyph->advance;
+    memcpy(stored.quad, glyph->quad, sizeof(stored.quad));
+    memcpy(stored.uv, glyph->uv, sizeof(stored.uv));
+    written = _write(file, &stored, sizeof(CacheGlyph), &header.checksum);
+  }
+
+  // Blank pages for the ones that are null.
+  size_t pageSize = (size_t)key->pageWidth * key->pageHeight;
+  unsigned char* blank = calloc(pageSize, 1);
+  uint64_t blankChecksum = NR_AtlasCache_Hash(blank, pageSize);
+
+  for (unsigned int i = 0; i < pageCount && written; ++i) {
+    uint64_t pageChecksum = pages[i] ? NR_AtlasCache_Hash(pages[i], pageSize) : blankChecksum;
+    written = _write(file, &pageChecksum, sizeof(uint64_t), &header.checksum);
+  }
+
+  // The pages aren't part of the file's checksum, they have their own.
+  for (unsigned int i = 0; i < pageCount && written; ++i) {
+    written = fwrite(pages[i] ? pages[i] : blank, 1, pageSize, file) == pageSize;
+  }
+  free(blank);
+
+  if (written) {
+    fseek(file, 0, SEEK_SET);
+    written = fwrite(&header, sizeof(CacheHeader), 1, file) == 1;
+  }
+
+  written = fclose(file) == 0 && written;
+  if (written)
+    written = NR_File_Replace(tempPath, path);
+  if (!written)
+    remove(tempPath);
+
+  free(tempPath);
+  return written;
+}
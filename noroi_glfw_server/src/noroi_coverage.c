@@ -0,0 +1,62 @@
+#include <noroi/glfw_server/noroi_coverage.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CODEPOINT_COUNT 0x110000
+#define BLOCK_SHIFT 8
+#define BLOCK_COUNT (CODEPOINT_COUNT >> BLOCK_SHIFT)
+#define WORDS_PER_BLOCK ((1 << BLOCK_SHIFT) / 32)
+
+// Internal representation of NR_Coverage
+typedef struct {
+  // Which block each run of 256 codepoints uses. Block 0 is always empty.
+  uint16_t blocks[BLOCK_COUNT];
+
+  // The bits of each block, WORDS_PER_BLOCK words at a time.
+  uint32_t* bits;
+  unsigned int blockCount;
+} HandleType;
+
+NR_Coverage NR_Coverage_New() {
+  HandleType* hnd = malloc(sizeof(HandleType));
+  memset(hnd->blocks, 0, sizeof(hnd->blocks));
+  hnd->bits = calloc(WORDS_PER_BLOCK, sizeof(uint32_t));
+  hnd->blockCount = 1;
+
+  return (void*)hnd;
+}
+
+void NR_Coverage_Delete(NR_Coverage coverage) {
+  HandleType* hnd = (HandleType*)coverage;
+  free(hnd->bits);
+  free(hnd);
+}
+
+void NR_Coverage_Add(NR_Coverage coverage, unsigned int codepoint) {
+  HandleType* hnd = (HandleType*)coverage;
+  if (codepoint >= CODEPOINT_COUNT)
+    return;
+
+  // Give the codepoint's run a block of its own the first time something's in it.
+  uint16_t* block = &hnd->blocks[codepoint >> BLOCK_SHIFT];
+  if (*block == 0) {
+    hnd->bits = realloc(hnd->bits, sizeof(uint32_t) * WORDS_PER_BLOCK * (hnd->blockCount + 1));
+    memset(hnd->bits + hnd->blockCount * WORDS_PER_BLOCK, 0, sizeof(uint32_t) * WORDS_PER_BLOCK);
+    *block = (uint16_t)hnd->blockCount++;
+  }
+
+  unsigned int bit = codepoint & ((1 << BLOCK_SHIFT) - 1);
+  hnd->bits[*block * WORDS_PER_BLOCK + (bit >> 5)] |= 1u << (bit & 31);
+}
+
+bool NR_Coverage_Has(NR_Coverage coverage, unsigned int codepoint) {
+  HandleType* hnd = (HandleType*)coverage;
+  if (codepoint >= CODEPOINT_COUNT)
+    return false;
+
+  unsigned int block = hnd->blocks[codepoint >> BLOCK_SHIFT];
+  unsigned int bit = codepoint & ((1 << BLOCK_SHIFT) - 1);
+  return (hnd->bits[block * WORDS_PER_BLOCK + (bit >> 5)] >> (bit & 31)) & 1;
+}
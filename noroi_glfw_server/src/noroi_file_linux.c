@@ -0,0 +1,74 @@
+#include <noroi/glfw_server/noroi_file.h>
+
+#ifdef __linux__
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+bool NR_File_Map(const char* path, NR_File_Mapping* mapping) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+    close(fd);
+    return false;
+  }
+
+  // The mapping stays valid once the file's closed.
+  void* data = mmap((void*)0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    return false;
+
+  mapping->data = (const unsigned char*)data;
+  mapping->size = (unsigned int)st.st_size;
+  mapping->handle = (void*)0;
+  return true;
+}
+
+void NR_File_Unmap(NR_File_Mapping* mapping) {
+  if (mapping->data)
+    munmap((void*)mapping->data, mapping->size);
+
+  mapping->data = (void*)0;
+  mapping->size = 0;
+}
+
+bool NR_File_GetCacheDirectory(char* buff, unsigned int buffSize) {
+  // $XDG_CACHE_HOME/noroi, or ~/.cache/noroi if that isn't set.
+  const char* cacheHome = getenv("XDG_CACHE_HOME");
+  int written;
+  if (cacheHome && cacheHome[0]) {
+    written = snprintf(buff, buffSize, "%s/noroi", cacheHome);
+  } else {
+    const char* home = getenv("HOME");
+    if (!home || !home[0])
+      return false;
+
+    written = snprintf(buff, buffSize, "%s/.cache", home);
+    if (written < 0 || (unsigned int)written >= buffSize)
+      return false;
+    mkdir(buff, 0700);
+
+    written = snprintf(buff, buffSize, "%s/.cache/noroi", home);
+  }
+
+  if (written < 0 || (unsigned int)written >= buffSize)
+    return false;
+
+  mkdir(buff, 0700);
+
+  struct stat st;
+  return stat(buff, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+bool NR_File_Replace(const char* from, const char* to) {
+  return rename(from, to) == 0;
+}
+
+#endif
@@ -0,0 +1,68 @@
+#include <noroi/glfw_server/noroi_file.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+bool NR_File_Map(const char* path, NR_File_Mapping* mapping) {
+  HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, (void*)0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, (void*)0);
+  if (file == INVALID_HANDLE_VALUE)
+    return false;
+
+  DWORD size = GetFileSize(file, (void*)0);
+  if (size == 0 || size == INVALID_FILE_SIZE) {
+    CloseHandle(file);
+    return false;
+  }
+
+  // The mapping keeps the file open itself.
+  HANDLE fileMapping = CreateFileMappingA(file, (void*)0, PAGE_READONLY, 0, 0, (void*)0);
+  CloseHandle(file);
+  if (!fileMapping)
+    return false;
+
+  const void* data = MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0);
+  if (!data) {
+    CloseHandle(fileMapping);
+    return false;
+  }
+
+  mapping->data = (const unsigned char*)data;
+  mapping->size = (unsigned int)size;
+  mapping->handle = (void*)fileMapping;
+  return true;
+}
+
+void NR_File_Unmap(NR_File_Mapping* mapping) {
+  if (mapping->data) {
+    UnmapViewOfFile(mapping->data);
+    CloseHandle((HANDLE)mapping->handle);
+  }
+
+  mapping->data = (void*)0;
+  mapping->size = 0;
+  mapping->handle = (void*)0;
+}
+
+bool NR_File_GetCacheDirectory(char* buff, unsigned int buffSize) {
+  // %LOCALAPPDATA%\noroi
+  const char* localAppData = getenv("LOCALAPPDATA");
+  if (!localAppData || !localAppData[0])
+    return false;
+
+  int written = _snprintf(buff, buffSize, "%s\\noroi", localAppData);
+  if (written < 0 || (unsigned int)written >= buffSize)
+    return false;
+
+  CreateDirectoryA(buff, (void*)0);
+
+  DWORD attributes = GetFileAttributesA(buff);
+  return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+}
+
+bool NR_File_Replace(const char* from, const char* to) {
+  return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+#endif
@@ -0,0 +1,144 @@
+#include <noroi/glfw_server/noroi_font_data.h>
+
+#include <noroi/glfw_server/noroi_atlas_cache.h>
+#include <noroi/glfw_server/noroi_file.h>
+#include <noroi/glfw_server/noroi_font_retriever.h>
+#include <noroi/base/tinycthread.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+// Internal representation of NR_FontData
+typedef struct FontData {
+  char* path;
+  unsigned int references;
+
+  // A mapped file, or the data of a font descriptor if mapping.data is null.
+  NR_File_Mapping mapping;
+  unsigned char* buff;
+  const unsigned char* data;
+  unsigned int size;
+
+  uint64_t hash;
+  bool hashed;
+
+  struct FontData* next;
+} HandleType;
+
+// Every font that's open. Each server loads fonts on its own thread, so the list is locked.
+static HandleType* g_fonts = (void*)0;
+static mtx_t g_fontsMutex;
+static once_flag g_fontsMutexOnce = ONCE_FLAG_INIT;
+
+static void _initFontsMutex(void) {
+  mtx_init(&g_fontsMutex, mtx_plain);
+}
+
+NR_FontData NR_FontData_Open(const char* path) {
+  call_once(&g_fontsMutexOnce, _initFontsMutex);
+  mtx_lock(&g_fontsMutex);
+
+  // Share it if it's already open.
+  for (HandleType* hnd = g_fonts; hnd; hnd = hnd->next) {
+    if (strcmp(hnd->path, path) == 0) {
+      hnd->references++;
+      mtx_unlock(&g_fontsMutex);
+      return (void*)hnd;
+    }
+  }
+
+  HandleType* hnd = malloc(sizeof(HandleType));
+  memset(hnd, 0, sizeof(HandleType));
+
+  if (NR_File_Map(path, &hnd->mapping)) {
+    hnd->data = hnd->mapping.data;
+    hnd->size = hnd->mapping.size;
+  } else {
+    // Try treating the path as a font descriptor
+    // Get the font file data and keep that.
+    unsigned int size = NR_FontRetrieval_GetFontDataSize(path);
+    if (size > 0) {
+      hnd->buff = malloc(sizeof(char) * size);
+      if (NR_FontRetrieval_GetFontData(path, (char*)hnd->buff, size)) {
+        hnd->data = hnd->buff;
+        hnd->size = size;
+      }
+    }
+
+    // Couldn't find anything.
+    if (!hnd->data) {
+      free(hnd->buff);
+      free(hnd);
+      mtx_unlock(&g_fontsMutex);
+      return (void*)0;
+    }
+  }
+
+  hnd->path = malloc(strlen(path) + 1);
+  strcpy(hnd->path, path);
+  hnd->references = 1;
+
+  hnd->next = g_fonts;
+  g_fonts = hnd;
+  mtx_unlock(&g_fontsMutex);
+
+  return (void*)hnd;
+}
+
+void NR_FontData_Release(NR_FontData font) {
+  HandleType* hnd = (HandleType*)font;
+  mtx_lock(&g_fontsMutex);
+  if (--hnd->references > 0) {
+    mtx_unlock(&g_fontsMutex);
+    return;
+  }
+
+  // Take it out of the list.
+  HandleType** link = &g_fonts;
+  while (*link != hnd)
+    link = &(*link)->next;
+  *link = hnd->next;
+  mtx_unlock(&g_fontsMutex);
+
+  NR_File_Unmap(&hnd->mapping);
+  free(hnd->buff);
+  free(hnd->path);
+  free(hnd);
+}
+
+const unsigned char* NR_FontData_GetData(NR_FontData font) {
+  HandleType* hnd = (HandleType*)font;
+  return hnd->data;
+}
+
+unsigned int NR_FontData_GetSize(NR_FontData font) {
+  HandleType* hnd = (HandleType*)font;
+  return hnd->size;
+}
+
+// How much of the start of a font is enough to tell it apart: the sfnt header and table directory, which
+// has a checksum of every table. Collections, and anything else, have to be hashed whole.
+static unsigned int _identifyingSize(const HandleType* hnd) {
+  if (hnd->size < 12 || memcmp(hnd->data, "ttcf", 4) == 0)
+    return hnd->size;
+
+  unsigned int tableCount = ((unsigned int)hnd->data[4] << 8) | hnd->data[5];
+  unsigned int directorySize = 12 + 16 * tableCount;
+  return directorySize < hnd->size ? directorySize : hnd->size;
+}
+
+uint64_t NR_FontData_GetHash(NR_FontData font) {
+  HandleType* hnd = (HandleType*)font;
+  mtx_lock(&g_fontsMutex);
+  if (!hnd->hashed) {
+    uint64_t parts[2];
+    parts[0] = NR_AtlasCache_Hash(hnd->data, _identifyingSize(hnd));
+    parts[1] = hnd->size;
+    hnd->hash = NR_AtlasCache_Hash(parts, sizeof(parts));
+    hnd->hashed = true;
+  }
+  uint64_t hash = hnd->hash;
+  mtx_unlock(&g_fontsMutex);
+
+  return hash;
+}
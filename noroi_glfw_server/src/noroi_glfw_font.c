@@ -1,87 +1,54 @@
 #include <noroi/glfw_server/noroi_glfw_font.h>
 
-#include <noroi/glfw_server/noroi_font_retriever.h>
+#include <noroi/glfw_server/noroi_glfw_renderer.h>
+#include <noroi/glfw_server/noroi_font_data.h>
 #include <noroi/glfw_server/noroi_glyphpacker.h>
-
-#define GLFW_INCLUDE_NONE
-#include <GLFW/glfw3.h>
+#include <noroi/glfw_server/noroi_glyph_rasterizer.h>
+#include <noroi/glfw_server/noroi_atlas_cache.h>
+#include <noroi/glfw_server/noroi_file.h>
 
 #include <glad/glad.h>
 
 #include <stddef.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <time.h>
 
 // Freetype.
 #include <ft2build.h>
 #include FT_FREETYPE_H
 
-// Include shaders.
-#include <noroi/glfw_server/shaders/fragment.h>
-#include <noroi/glfw_server/shaders/geometry.h>
-#include <noroi/glfw_server/shaders/vertex.h>
-
+// Atlas pages, each a layer of one array texture. The atlas starts with a page and doubles while it
+// fits in the budget, after which the least recently used page is emptied to make room.
 #define PAGE_WIDTH 1024
 #define PAGE_HEIGHT 1024
-#define PAGE_COUNT 10
-#define MAX_VERTICES_PER_FLUSH 2048
-
-// Utility function for loading a shader.
-GLuint loadShader(const char* source, GLenum type) {
-  // Create a shader to draw with.
-  GLuint shader = glCreateShader(type);
-  glShaderSource(shader, 1, (const GLchar**)&source, (void*)0);
-  glCompileShader(shader);
-
-  printf("Compiling shader: %s\n", source);
-
-  // Compile it.
-  GLint success;
-  glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-  if (success == GL_FALSE) {
-    GLint maxLength = 0;
-  	glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &maxLength);
+#define DEFAULT_ATLAS_BUDGET (16 * PAGE_WIDTH * PAGE_HEIGHT)
 
-    // Allocate space for log.
-    char* log = malloc(sizeof(char) * maxLength);
+// For _packGlyph, to put a glyph on whichever page has room.
+#define ANY_PAGE UINT_MAX
 
-    // Get name of shader type.
-    const char* shaderTypeString;
-    if (type == GL_GEOMETRY_SHADER) shaderTypeString = "geometry";
-    if (type == GL_VERTEX_SHADER) shaderTypeString = "vertex";
-    if (type == GL_FRAGMENT_SHADER) shaderTypeString = "fragment";
+// Each size a glyph is rendered at has a packer variant for every combination of NR_GlyphStyle.
+#define STYLE_COUNT 4
 
-    glGetShaderInfoLog(shader, sizeof(char) * maxLength, &maxLength, log);
-    printf("Error compiling %s shader: %s\n", shaderTypeString, log);
+// The height distance fields are rendered at, whatever size they're drawn at.
+#define DISTANCE_FIELD_SIZE 48
 
-    // Free log
-    free(log);
-
-    return 0;
-  }
-
-  return shader;
-}
+// How many vertex buffers each page cycles through. The GPU can still be drawing
+// from the last couple of frames while we fill the next one.
+#define BUFFER_RING_SIZE 3
 
-// Link shaders together into a single program.
-GLuint linkProgram(GLuint* shaders, int count) {
-  // Create the program, attache the shaders and link the program.
-  GLuint program = glCreateProgram();
-  for (int i = 0; i < count; ++i) {
-    glAttachShader(program, shaders[i]);
-  }
-  glLinkProgram(program);
+// Runs of changed cells closer than this are uploaded as one, unchanged cells and all. Past either limit
+// the whole buffer is uploaded at once instead, as one call is cheaper than many small ones.
+#define UPLOAD_MERGE_GAP 64
+#define MAX_UPLOAD_RUNS 16
+#define MAX_UPLOAD_FRACTION 0.5f
 
-  // Get the status of the linking.
-  GLint success;
-  GLchar log[512];
-  glGetProgramiv(program, GL_LINK_STATUS, &success);
-  if (!success) {
-    glGetProgramInfoLog(program, sizeof(log), (void*)0, log);
-    printf("Font shader link error:\n %s\n", log);
-    return 0;
-  }
+// The most rendered glyphs to add to the atlas in one draw. Any more wait for the next one.
+#define GLYPHS_PER_DRAW 256
 
-  return program;
-}
+// How many seconds the atlas has to go without changing before it's saved to the cache whilst drawing.
+#define CACHE_SAVE_DELAY 2.0
 
 // Vectors
 typedef struct {
@@ -96,65 +63,218 @@ typedef struct {
   GLfloat x, y, z, w;
 } Vec4d;
 
-// Vertex flags.
+// Vertex flags, kept in the top 8 bits of a vertex's glyph.
 typedef enum {
   VERTEX_FLAGS_FLASHING = 1,
   VERTEX_FLAGS_ITALICS = 2,
   VERTEX_FLAGS_BOLD = 4
 } VertexFlags;
 
-// Define a vertex in our vertex buffer.
-typedef struct {
-  // Colors for the ghyph and the background.
-  Vec3d color;
-  Vec3d bgColor;
+#define VERTEX_GLYPH_MASK 0x00FFFFFF
+#define VERTEX_FLAGS_SHIFT 24
 
-  // Rect for the glyph.
-  Vec4d glyphRect;
+// The glyph index for a cell with only a background to draw.
+#define NO_GLYPH VERTEX_GLYPH_MASK
 
-  // Our texture coordinates.
-  Vec4d textureRect;
+// Define a vertex in our vertex buffer, one per cell. The shaders work out the rects from
+// the cell's position and the glyph's metrics. It's also exactly one RGBA32UI texel, so the
+// same data can be uploaded as the grid texture.
+typedef struct {
+  // Position in the grid.
+  GLushort x, y;
 
-  // Rect for the background color rect.
-  Vec4d bgRect;
+  // Index into the glyph metrics, with flags in the top 8 bits.
+  GLuint glyph;
 
-  // Glyph options.
-  unsigned char flags;
+  // Colors for the ghyph and the background. Either packed RGBA or palette indices,
+  // the shader unpacks them.
+  GLuint color;
+  GLuint bgColor;
 } Vertex;
 
-// Defines a single page of glyphs.
+// Where a glyph goes in a cell and on the atlas, as read by the shaders (three RGBA32F texels).
+typedef struct {
+  GLfloat quad[4];
+  GLfloat uv[4];
+  GLfloat page;
+  GLfloat distanceField; // 1 if the glyph is a distance field rather than coverage.
+  GLfloat padding[2];
+} GlyphMetrics;
+
+// A copy of an atlas page, and the part of it that's changed since it was last uploaded.
+typedef struct {
+  unsigned char* pixels; // Allocated the first time something goes on the page.
+  bool dirty;
+  unsigned int dirtyX0, dirtyY0, dirtyX1, dirtyY1;
+
+  // How many cells are drawing glyphs from the page, and the last frame any were, or a glyph was added.
+  unsigned int cells;
+  unsigned int lastUsed;
+} Page;
+
+// A size glyphs have been rendered at, as given to NR_Font_SetResolution, or the distance field size.
+typedef struct {
+  int width, height;
+  bool distanceField;
+} PixelSize;
+
+// How a glyph in the atlas is being used, by the glyph's index.
+typedef struct {
+  unsigned int cells;    // How many cells are drawing it.
+  unsigned int lastUsed; // The last frame a cell drew it, or it was added.
+  unsigned int page;
+} GlyphUsage;
+
+// A buffer holding a vertex for every cell in the grid.
 typedef struct {
-  GLuint texture;
   GLuint vao;
+  GLuint instancedVao; // The same buffer, read per instance.
   GLuint vbo;
-  unsigned int current;
-} Page;
+  GLsizeiptr size;
+
+  // The frame this buffer was last brought up to date in.
+  unsigned int frame;
+
+  // Signalled once the GPU has finished drawing from this buffer.
+  GLsync fence;
+} VertexBuffer;
 
 // Internal representation of NR_Font
 typedef struct {
-  // The actual font.
+  // The actual font, for its metrics, and the data of each font in the fallback chain.
   FT_Face face;
+  NR_FontData* fontData;
+  unsigned int fontCount;
+
+  // Renders glyphs for us in the background, and the ranges to have it render up front.
+  NR_GlyphRasterizer rasterizer;
+  NR_Codepoint_Range* prewarmRanges;
+  unsigned int prewarmCount;
 
   // Maximum char width and height.
   int charWidth, charHeight;
 
+  // How glyphs are rendered, and the resolution they're rendered at if they aren't distance fields.
+  NR_Font_Raster raster;
+  int resolutionWidth, resolutionHeight;
+
+  // Every resolution glyphs have been rendered at. Glyphs at each are kept in the atlas as packer variants
+  // sizeIndex * STYLE_COUNT + style, so changing back to an old resolution finds them still there.
+  PixelSize* sizes;
+  unsigned int sizeCount;
+  unsigned int sizeIndex;
+
   // Packed textures containing the font glyphs.
   NR_GlyphPacker* glyphpacker;
 
-  // Pages
-  Page* pages[PAGE_COUNT];
+  // Every page of glyphs, as layers of one array texture. Glyphs are drawn onto our copy of each
+  // page first, then the changed part of each page is uploaded through the staging buffer in one go.
+  // The texture is resized to pageCount layers the next time pages are uploaded, from our copies.
+  GLuint atlas;
+  Page* pages;
+  unsigned int pageCount, maxPages;
+  unsigned int atlasLayers;
+  GLuint stagingBuffer;
+
+  // Metrics and usage for each glyph in the atlas, indexed by the glyph's index, and a texture
+  // buffer to give the metrics to the shaders in. Indices of evicted glyphs are reused. Everything
+  // before metricsUploaded is already on the GPU.
+  GlyphMetrics* metrics;
+  GlyphUsage* usage;
+  unsigned int* freeIndices;
+  unsigned int freeCount;
+  unsigned int metricsCount, metricsCapacity;
+  unsigned int metricsUploaded, metricsBufferCapacity;
+  GLuint metricsBuffer;
+  GLuint metricsTexture;
+
+  // The glyphs in the atlas at every size, in the order they were packed onto each page, to save to the atlas cache.
+  NR_GlyphPacker_Glyph* glyphs;
+  unsigned int glyphCount, glyphCapacity;
+  bool cacheDirty;       // The atlas has changed since it was last cached.
+  time_t cacheChangedAt; // When glyphs last arrived, or we last tried to save.
+
+  // A vertex for each cell in the grid, kept between frames so that only cells
+  // that change need to be rebuilt and uploaded.
+  Vertex* vertices;
+  NR_Glyph* cells;       // What each cell held when its vertex was built.
+  unsigned int* changed; // The frame each cell's vertex last changed in.
+  bool* waiting;         // Whether each cell is waiting for its glyph to be rendered.
+  int gridWidth, gridHeight;
+  int gridX, gridY;
+  bool rebuild;          // Rebuild every cell next time we draw.
+  unsigned int frame;
+
+  // Buffers to upload into, used one after the other.
+  VertexBuffer buffers[BUFFER_RING_SIZE];
+  unsigned int currentBuffer;
+
+  // The grid as a texture, for NR_FONT_PIPELINE_GRID_TEXTURE, and the frame it was last brought up to date in.
+  GLuint gridTexture;
+  int gridTextureWidth, gridTextureHeight;
+  unsigned int gridTextureFrame;
+
+  // How much work the last draw took.
+  NR_Font_Stats stats;
+
+  // What to draw with, and which of its pipelines to use.
+  NR_Renderer renderer;
+  NR_Font_Pipeline pipeline;
+
+  // Palette, and a uniform buffer to give it to the shader in.
+  NR_ColorMode colorMode;
+  unsigned int palette[NR_PALETTE_SIZE];
+  bool paletteDirty;
+  GLuint paletteUbo;
+} HandleType;
 
-  // A VBO and VAO to draw the background colors.
-  GLuint bgVao;
-  GLuint bgVbo;
+// Describe the vertex format to the bound vertex array. With a divisor of 1 each vertex
+// is read once per instance.
+static void _describeVertex(GLuint divisor) {
+  glEnableVertexAttribArray(NR_RENDERER_ATTRIB_CELL);
+  glVertexAttribIPointer(NR_RENDERER_ATTRIB_CELL, 2, GL_UNSIGNED_SHORT, sizeof(Vertex), (void*)offsetof(Vertex, x));
+  glVertexAttribDivisor(NR_RENDERER_ATTRIB_CELL, divisor);
 
-  // A shader to draw characters with.
-  GLuint program;
-} HandleType;
+  glEnableVertexAttribArray(NR_RENDERER_ATTRIB_GLYPH);
+  glVertexAttribIPointer(NR_RENDERER_ATTRIB_GLYPH, 1, GL_UNSIGNED_INT, sizeof(Vertex), (void*)offsetof(Vertex, glyph));
+  glVertexAttribDivisor(NR_RENDERER_ATTRIB_GLYPH, divisor);
+
+  glEnableVertexAttribArray(NR_RENDERER_ATTRIB_COLOR);
+  glVertexAttribIPointer(NR_RENDERER_ATTRIB_COLOR, 1, GL_UNSIGNED_INT, sizeof(Vertex), (void*)offsetof(Vertex, color));
+  glVertexAttribDivisor(NR_RENDERER_ATTRIB_COLOR, divisor);
+
+  glEnableVertexAttribArray(NR_RENDERER_ATTRIB_BG_COLOR);
+  glVertexAttribIPointer(NR_RENDERER_ATTRIB_BG_COLOR, 1, GL_UNSIGNED_INT, sizeof(Vertex), (void*)offsetof(Vertex, bgColor));
+  glVertexAttribDivisor(NR_RENDERER_ATTRIB_BG_COLOR, divisor);
+}
+
+// Create a vertex buffer, with a vertex array for each pipeline to read it through.
+static void _createVertexBuffer(HandleType* hnd, VertexBuffer* buffer) {
+  memset(buffer, 0, sizeof(VertexBuffer));
+  glGenBuffers(1, &buffer->vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, buffer->vbo);
+
+  // One vertex per cell, expanded by the geometry shader.
+  glGenVertexArrays(1, &buffer->vao);
+  NR_Renderer_BindVertexArray(hnd->renderer, buffer->vao);
+  _describeVertex(0);
+
+  // One instance per cell.
+  glGenVertexArrays(1, &buffer->instancedVao);
+  NR_Renderer_BindVertexArray(hnd->renderer, buffer->instancedVao);
+  _describeVertex(1);
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
 
 // Initialize freetype.
 FT_Library g_freetypeLibrary;
 bool g_initialized = false;
+
+// Where atlas caches are kept, null if they aren't.
+char* g_cacheDirectory = (void*)0;
+bool g_cacheDirectoryChosen = false;
+
 bool NR_Font_Init() {
   // Only initialize once.
   if (!g_initialized) {
@@ -163,6 +283,13 @@ bool NR_Font_Init() {
       return false;
     }
 
+    // Keep atlas caches with the user's other caches, unless we've been told otherwise.
+    if (!g_cacheDirectoryChosen) {
+      char directory[4096];
+      if (NR_File_GetCacheDirectory(directory, sizeof(directory)))
+        NR_Font_SetCacheDirectory(directory);
+    }
+
     g_initialized = true;
   }
 
@@ -175,32 +302,437 @@ void NR_Font_Shutdown() {
     // De-initialize freetype.
     FT_Done_FreeType(g_freetypeLibrary);
 
+    free(g_cacheDirectory);
+    g_cacheDirectory = (void*)0;
+    g_cacheDirectoryChosen = false;
+
     g_initialized = false;
   }
 }
 
-// Load a freetype font.
-NR_Font NR_Font_Load(const char* path) {
-  // Attempt to load the font.
-  FT_Face face;
-  FT_Error err = FT_New_Face(g_freetypeLibrary, path, 0, &face);
-
-  if (err != 0) {
-    // Try treating the path as a font descriptor
-    // Get the font file data and attempt to load that.
-    unsigned int size = NR_FontRetrieval_GetFontDataSize(path);
-    if (size > 0) {
-      char* buff = malloc(sizeof(char) * size);
-      if (NR_FontRetrieval_GetFontData(path, buff, size)) {
-       err = FT_New_Memory_Face(g_freetypeLibrary, (unsigned char*)buff, size, 0, &face);
+void NR_Font_SetCacheDirectory(const char* path) {
+  free(g_cacheDirectory);
+  g_cacheDirectory = (void*)0;
+  if (path) {
+    g_cacheDirectory = malloc(strlen(path) + 1);
+    strcpy(g_cacheDirectory, path);
+  }
+
+  g_cacheDirectoryChosen = true;
+}
+
+// Get the index of a size, adding it if it's new.
+static unsigned int _sizeIndex(HandleType* hnd, int width, int height, bool distanceField) {
+  for (unsigned int i = 0; i < hnd->sizeCount; ++i) {
+    if (hnd->sizes[i].width == width && hnd->sizes[i].height == height && hnd->sizes[i].distanceField == distanceField)
+      return i;
+  }
+
+  hnd->sizes = realloc(hnd->sizes, sizeof(PixelSize) * (hnd->sizeCount + 1));
+  hnd->sizes[hnd->sizeCount].width = width;
+  hnd->sizes[hnd->sizeCount].height = height;
+  hnd->sizes[hnd->sizeCount].distanceField = distanceField;
+  return hnd->sizeCount++;
+}
+
+// The rasterizer's key for a glyph in the packer.
+static NR_GlyphRasterizer_Key _glyphKey(HandleType* hnd, unsigned int codepoint, unsigned int variant) {
+  NR_GlyphRasterizer_Key key;
+  key.codepoint = codepoint;
+  key.width = hnd->sizes[variant / STYLE_COUNT].width;
+  key.height = hnd->sizes[variant / STYLE_COUNT].height;
+  key.style = variant % STYLE_COUNT;
+  key.distanceField = hnd->sizes[variant / STYLE_COUNT].distanceField;
+  return key;
+}
+
+// Ask the rasterizer for every glyph in the prewarm ranges that the face has, at the current resolution.
+static void _requestRanges(HandleType* hnd) {
+  unsigned int variant = hnd->sizeIndex * STYLE_COUNT + NR_GLYPH_STYLE_REGULAR;
+  for (unsigned int i = 0; i < hnd->prewarmCount; ++i) {
+    for (unsigned int codepoint = hnd->prewarmRanges[i].first; codepoint <= hnd->prewarmRanges[i].last; ++codepoint) {
+      NR_GlyphPacker_Glyph glyph;
+      if (NR_GlyphRasterizer_HasGlyph(hnd->rasterizer, codepoint) && !NR_GlyphPacker_Find(hnd->glyphpacker, codepoint, variant, &glyph)) {
+        NR_GlyphRasterizer_Key key = _glyphKey(hnd, codepoint, variant);
+        NR_GlyphRasterizer_Request(hnd->rasterizer, &key);
       }
-      free(buff);
+
+      // Don't wrap around at the top of the range.
+      if (codepoint == hnd->prewarmRanges[i].last)
+        break;
     }
+  }
+}
+
+// Give a glyph a slot in the metrics, reusing an evicted glyph's if there is one.
+static unsigned int _newIndex(HandleType* hnd) {
+  unsigned int index;
+  if (hnd->freeCount > 0) {
+    index = hnd->freeIndices[--hnd->freeCount];
+  } else {
+    if (hnd->metricsCount == hnd->metricsCapacity) {
+      hnd->metricsCapacity = hnd->metricsCapacity ? hnd->metricsCapacity * 2 : 256;
+      hnd->metrics = realloc(hnd->metrics, sizeof(GlyphMetrics) * hnd->metricsCapacity);
+      hnd->usage = realloc(hnd->usage, sizeof(GlyphUsage) * hnd->metricsCapacity);
+      hnd->freeIndices = realloc(hnd->freeIndices, sizeof(unsigned int) * hnd->metricsCapacity);
+    }
+    index = hnd->metricsCount++;
+  }
+
+  hnd->usage[index].cells = 0;
+  return index;
+}
+
+static void _freeIndex(HandleType* hnd, unsigned int index) {
+  hnd->freeIndices[hnd->freeCount++] = index;
+}
+
+// Find room for a glyph in the atlas, on the given page or on any, for the slot in its index. Its
+// metrics are uploaded next time we draw.
+static bool _packGlyph(HandleType* hnd, NR_GlyphPacker_Glyph* glyph, unsigned int page) {
+  bool added = page == ANY_PAGE ? NR_GlyphPacker_Add(hnd->glyphpacker, glyph)
+                                : NR_GlyphPacker_AddToPage(hnd->glyphpacker, glyph, page);
+  if (!added || !NR_GlyphPacker_Find(hnd->glyphpacker, glyph->codepoint, glyph->variant, glyph))
+    return false;
+
+  if (hnd->glyphCount == hnd->glyphCapacity) {
+    hnd->glyphCapacity = hnd->glyphCapacity ? hnd->glyphCapacity * 2 : 256;
+    hnd->glyphs = realloc(hnd->glyphs, sizeof(NR_GlyphPacker_Glyph) * hnd->glyphCapacity);
+  }
+  hnd->glyphs[hnd->glyphCount++] = *glyph;
+  hnd->usage[glyph->index].page = glyph->page;
+  hnd->usage[glyph->index].lastUsed = hnd->frame;
+  hnd->pages[glyph->page].lastUsed = hnd->frame;
+  hnd->cacheDirty = true;
+
+  GlyphMetrics* metrics = &hnd->metrics[glyph->index];
+  memset(metrics, 0, sizeof(GlyphMetrics));
+  memcpy(metrics->quad, glyph->quad, sizeof(metrics->quad));
+  memcpy(metrics->uv, glyph->uv, sizeof(metrics->uv));
+  metrics->page = (GLfloat)glyph->page;
+  metrics->distanceField = hnd->sizes[glyph->variant / STYLE_COUNT].distanceField ? 1.0f : 0.0f;
+  if (glyph->index < hnd->metricsUploaded)
+    hnd->metricsUploaded = glyph->index;
+
+  return true;
+}
+
+// Add pages to the atlas, up to count or as many as fit in the budget. Returns false if there's no more room.
+static bool _growAtlas(HandleType* hnd, unsigned int count) {
+  if (count > hnd->maxPages)
+    count = hnd->maxPages;
+  if (count <= hnd->pageCount)
+    return false;
 
-    // Still couldn't load anything.
-    if (err != 0) {
+  hnd->pages = realloc(hnd->pages, sizeof(Page) * count);
+  memset(hnd->pages + hnd->pageCount, 0, sizeof(Page) * (count - hnd->pageCount));
+  hnd->pageCount = count;
+  NR_GlyphPacker_SetPageCount(hnd->glyphpacker, count);
+
+  return true;
+}
+
+// Make all of a page dirty, so it gets uploaded whole.
+static void _dirtyPage(Page* page) {
+  page->dirty = true;
+  page->dirtyX0 = 0;
+  page->dirtyY0 = 0;
+  page->dirtyX1 = PAGE_WIDTH;
+  page->dirtyY1 = PAGE_HEIGHT;
+}
+
+// Copy a glyph's pixels onto our copy of its page, growing the page's dirty rect to cover them.
+static void _blitGlyph(HandleType* hnd, const NR_GlyphPacker_Glyph* glyph, const unsigned char* pixels, unsigned int pitch) {
+  Page* page = &hnd->pages[glyph->page];
+
+  // Start the page off blank the first time something goes on it, making all of it dirty so the layer gets cleared too.
+  if (!page->pixels) {
+    page->pixels = calloc(PAGE_WIDTH * PAGE_HEIGHT, 1);
+    _dirtyPage(page);
+  }
+
+  for (unsigned int y = 0; y < glyph->height; ++y) {
+    memcpy(page->pixels + (glyph->y + y) * PAGE_WIDTH + glyph->x, pixels + y * pitch, glyph->width);
+  }
+
+  unsigned int x1 = glyph->x + glyph->width;
+  unsigned int y1 = glyph->y + glyph->height;
+  if (!page->dirty) {
+    page->dirty = true;
+    page->dirtyX0 = glyph->x;
+    page->dirtyY0 = glyph->y;
+    page->dirtyX1 = x1;
+    page->dirtyY1 = y1;
+  } else {
+    if (glyph->x < page->dirtyX0) page->dirtyX0 = glyph->x;
+    if (glyph->y < page->dirtyY0) page->dirtyY0 = glyph->y;
+    if (x1 > page->dirtyX1) page->dirtyX1 = x1;
+    if (y1 > page->dirtyY1) page->dirtyY1 = y1;
+  }
+}
+
+// Throw a glyph out of the atlas. It's rendered again if it's asked for again.
+static void _evictGlyph(HandleType* hnd, const NR_GlyphPacker_Glyph* glyph) {
+  NR_GlyphRasterizer_Key key = _glyphKey(hnd, glyph->codepoint, glyph->variant);
+  _freeIndex(hnd, glyph->index);
+  NR_GlyphRasterizer_Forget(hnd->rasterizer, &key);
+  hnd->stats.glyphsEvicted++;
+}
+
+// Whether a glyph is on screen, or was added this frame to be drawn.
+static bool _glyphInUse(HandleType* hnd, const NR_GlyphPacker_Glyph* glyph) {
+  const GlyphUsage* usage = &hnd->usage[glyph->index];
+  return usage->cells > 0 || usage->lastUsed == hnd->frame;
+}
+
+// Empty the least recently used page with a glyph that isn't in use, then pack the glyphs on it that
+// still are back onto it. Returns false if there's no page it's worth doing to.
+static bool _evictPage(HandleType* hnd) {
+  // Pages where every glyph is still in use are left alone.
+  bool* evictable = calloc(hnd->pageCount, sizeof(bool));
+  for (unsigned int i = 0; i < hnd->glyphCount; ++i) {
+    if (!_glyphInUse(hnd, &hnd->glyphs[i]))
+      evictable[hnd->glyphs[i].page] = true;
+  }
+
+  bool found = false;
+  unsigned int victim = 0;
+  for (unsigned int i = 0; i < hnd->pageCount; ++i) {
+    const Page* page = &hnd->pages[i];
+    const Page* best = &hnd->pages[victim];
+    if (!evictable[i] || !page->pixels)
+      continue;
+
+    if (!found || page->lastUsed < best->lastUsed || (page->lastUsed == best->lastUsed && page->cells < best->cells)) {
+      found = true;
+      victim = i;
+    }
+  }
+  free(evictable);
+
+  if (!found)
+    return false;
+  Page* page = &hnd->pages[victim];
+
+  // Take the page's glyphs out of the list, keeping aside the ones still in use.
+  NR_GlyphPacker_Glyph* kept = malloc(sizeof(NR_GlyphPacker_Glyph) * hnd->glyphCount);
+  unsigned int keptCount = 0, remaining = 0;
+  for (unsigned int i = 0; i < hnd->glyphCount; ++i) {
+    const NR_GlyphPacker_Glyph* glyph = &hnd->glyphs[i];
+    if (glyph->page != victim) {
+      hnd->glyphs[remaining++] = *glyph;
+    } else if (_glyphInUse(hnd, glyph)) {
+      kept[keptCount++] = *glyph;
+    } else {
+      _evictGlyph(hnd, glyph);
+    }
+  }
+  hnd->glyphCount = remaining;
+
+  // Start the page again, and repack what's left in the same order, copying it from the old pixels.
+  unsigned char* old = page->pixels;
+  page->pixels = calloc(PAGE_WIDTH * PAGE_HEIGHT, 1);
+  _dirtyPage(page);
+  NR_GlyphPacker_ClearPage(hnd->glyphpacker, victim);
+
+  for (unsigned int i = 0; i < keptCount; ++i) {
+    NR_GlyphPacker_Glyph glyph = kept[i];
+    if (_packGlyph(hnd, &glyph, victim)) {
+      _blitGlyph(hnd, &glyph, old + kept[i].y * PAGE_WIDTH + kept[i].x, PAGE_WIDTH);
+    } else {
+      // It doesn't fit in the new order. Cells drawing it have to find it again.
+      _evictGlyph(hnd, &kept[i]);
+      hnd->rebuild = true;
+    }
+  }
+
+  free(old);
+  free(kept);
+  hnd->stats.pagesEvicted++;
+  hnd->cacheDirty = true;
+
+  return true;
+}
+
+// Get the font's atlas cache file, if it can have one.
+static bool _getCachePath(HandleType* hnd, char* path, unsigned int size, NR_AtlasCache_Key* key) {
+  if (!g_cacheDirectory)
+    return false;
+
+  // A font on its own is known by its hash, a fallback chain by its fonts' hashes.
+  key->fontHash = NR_FontData_GetHash(hnd->fontData[0]);
+  if (hnd->fontCount > 1) {
+    uint64_t* hashes = malloc(sizeof(uint64_t) * hnd->fontCount);
+    for (unsigned int i = 0; i < hnd->fontCount; ++i) {
+      hashes[i] = NR_FontData_GetHash(hnd->fontData[i]);
+    }
+    key->fontHash = NR_AtlasCache_Hash(hashes, sizeof(uint64_t) * hnd->fontCount);
+    free(hashes);
+  }
+
+  key->pageWidth = PAGE_WIDTH;
+  key->pageHeight = PAGE_HEIGHT;
+
+  int written = snprintf(path, size, "%s/atlas-%016" PRIx64 ".cache", g_cacheDirectory, key->fontHash);
+  return written > 0 && (unsigned int)written < size;
+}
+
+// Save the atlas to the cache, if it's changed since it was cached.
+static void _saveCache(HandleType* hnd) {
+  char path[4096];
+  NR_AtlasCache_Key key;
+  if (!hnd->cacheDirty || hnd->glyphCount == 0 || !_getCachePath(hnd, path, sizeof(path), &key))
+    return;
+
+  // Only pages up to the last one with glyphs on.
+  unsigned int pageCount = 0;
+  for (unsigned int i = 0; i < hnd->glyphCount; ++i) {
+    if (hnd->glyphs[i].page + 1 > pageCount)
+      pageCount = hnd->glyphs[i].page + 1;
+  }
+
+  unsigned char** pages = malloc(sizeof(unsigned char*) * pageCount);
+  for (unsigned int i = 0; i < pageCount; ++i) {
+    pages[i] = hnd->pages[i].pixels;
+  }
+
+  // Variants only mean something to us, so save the size and style they stand for.
+  NR_AtlasCache_Glyph* glyphs = malloc(sizeof(NR_AtlasCache_Glyph) * hnd->glyphCount);
+  for (unsigned int i = 0; i < hnd->glyphCount; ++i) {
+    NR_GlyphRasterizer_Key glyphKey = _glyphKey(hnd, hnd->glyphs[i].codepoint, hnd->glyphs[i].variant);
+    glyphs[i].glyph = hnd->glyphs[i];
+    glyphs[i].pixelWidth = glyphKey.width;
+    glyphs[i].pixelHeight = glyphKey.height;
+    glyphs[i].style = glyphKey.style;
+    glyphs[i].distanceField = glyphKey.distanceField;
+  }
+
+  if (NR_AtlasCache_Save(path, &key, glyphs, hnd->glyphCount, pages, pageCount))
+    hnd->cacheDirty = false;
+  free(glyphs);
+  free(pages);
+}
+
+// Empty the atlas, keeping its pages.
+static void _clearAtlas(HandleType* hnd) {
+  NR_GlyphPacker_Delete(hnd->glyphpacker);
+  hnd->glyphpacker = NR_GlyphPacker_New(PAGE_WIDTH, PAGE_HEIGHT, hnd->pageCount);
+  hnd->metricsCount = 0;
+  hnd->metricsUploaded = 0;
+  hnd->freeCount = 0;
+  hnd->glyphCount = 0;
+  hnd->cacheDirty = false;
+}
+
+// Fill the empty atlas from the cache, if there's one for this font.
+static void _loadCache(HandleType* hnd) {
+  char path[4096];
+  NR_AtlasCache_Key key;
+  if (!_getCachePath(hnd, path, sizeof(path), &key))
+    return;
+
+  NR_AtlasCache cache = NR_AtlasCache_Open(path, &key);
+  if (!cache)
+    return;
+
+  // Pack the glyphs onto their pages in the same order as before, which should put them back in the same places.
+  unsigned int glyphCount = NR_AtlasCache_GetGlyphCount(cache);
+  unsigned int pageCount = NR_AtlasCache_GetPageCount(cache);
+  bool valid = pageCount <= hnd->maxPages;
+  if (valid)
+    _growAtlas(hnd, pageCount);
+  for (unsigned int i = 0; i < glyphCount && valid; ++i) {
+    NR_AtlasCache_Glyph cachedGlyph;
+    NR_AtlasCache_GetGlyph(cache, i, &cachedGlyph);
+    NR_GlyphPacker_Glyph cached = cachedGlyph.glyph;
+    NR_GlyphPacker_Glyph glyph = cached;
+    unsigned int size = _sizeIndex(hnd, cachedGlyph.pixelWidth, cachedGlyph.pixelHeight, cachedGlyph.distanceField);
+    glyph.variant = size * STYLE_COUNT + cachedGlyph.style % STYLE_COUNT;
+    glyph.index = _newIndex(hnd);
+
+    valid = cached.page < pageCount && _packGlyph(hnd, &glyph, cached.page) && glyph.x == cached.x && glyph.y == cached.y;
+  }
+
+  if (!valid) {
+    // The packer's changed since it was made, so it's no use. Start again and it'll be replaced.
+    _clearAtlas(hnd);
+    NR_AtlasCache_Close(cache);
+    return;
+  }
+
+  // Copy the pages over, to be uploaded next time we draw.
+  for (unsigned int i = 0; i < pageCount && valid; ++i) {
+    Page* page = &hnd->pages[i];
+    if (!page->pixels)
+      page->pixels = malloc(PAGE_WIDTH * PAGE_HEIGHT);
+    valid = NR_AtlasCache_CopyPage(cache, i, page->pixels);
+    _dirtyPage(page);
+  }
+
+  if (!valid) {
+    // A page has been damaged. Blank what we copied and start again.
+    for (unsigned int i = 0; i < pageCount; ++i) {
+      if (hnd->pages[i].pixels)
+        memset(hnd->pages[i].pixels, 0, PAGE_WIDTH * PAGE_HEIGHT);
+    }
+    _clearAtlas(hnd);
+    NR_AtlasCache_Close(cache);
+    return;
+  }
+
+  hnd->cacheDirty = false;
+  NR_AtlasCache_Close(cache);
+}
+
+// Let go of the data of count fonts.
+static void _releaseFontData(NR_FontData* fontData, unsigned int count) {
+  for (unsigned int i = 0; i < count; ++i) {
+    NR_FontData_Release(fontData[i]);
+  }
+  free(fontData);
+}
+
+// Load a freetype font.
+NR_Font NR_Font_Load(NR_Renderer renderer, const char* path) {
+  return NR_Font_LoadWithFallbacks(renderer, &path, 1);
+}
+
+NR_Font NR_Font_LoadWithFallbacks(NR_Renderer renderer, const char* const* paths, unsigned int count) {
+  if (count == 0)
+    return (void*)0;
+
+  // Find every font. Freetype reads from memory faces as it goes, so the data has to stay around as long as
+  // they do.
+  NR_FontData* fontData = malloc(sizeof(NR_FontData) * count);
+  NR_GlyphRasterizer_Source* sources = malloc(sizeof(NR_GlyphRasterizer_Source) * count);
+  for (unsigned int i = 0; i < count; ++i) {
+    fontData[i] = NR_FontData_Open(paths[i]);
+    if (!fontData[i]) {
+      _releaseFontData(fontData, i);
+      free(sources);
       return (void*)0;
     }
+
+    sources[i].path = paths[i];
+    sources[i].data = NR_FontData_GetData(fontData[i]);
+    sources[i].size = NR_FontData_GetSize(fontData[i]);
+  }
+
+  // Attempt to load the first font, for its metrics.
+  FT_Face face;
+  if (FT_New_Memory_Face(g_freetypeLibrary, sources[0].data, sources[0].size, 0, &face) != 0) {
+    _releaseFontData(fontData, count);
+    free(sources);
+    return (void*)0;
+  }
+
+  // Open the fonts again for rendering glyphs in the background.
+  NR_GlyphRasterizer rasterizer = NR_GlyphRasterizer_New(sources, count);
+  free(sources);
+  if (!rasterizer) {
+    FT_Done_Face(face);
+    _releaseFontData(fontData, count);
+    return (void*)0;
   }
 
   // Make sure we're using unicode mappings.
@@ -210,25 +742,64 @@ NR_Font NR_Font_Load(const char* path) {
   HandleType* hnd = malloc(sizeof(HandleType));
   memset(hnd, 0, sizeof(HandleType));
   hnd->face = face;
+  hnd->fontData = fontData;
+  hnd->fontCount = count;
+  hnd->rasterizer = rasterizer;
+  hnd->renderer = renderer;
 
-  // Create a glyphpacker
-  hnd->glyphpacker = NR_GlyphPacker_New(PAGE_WIDTH, PAGE_HEIGHT, PAGE_COUNT);
+  // Create a glyphpacker, starting with a page.
+  hnd->maxPages = DEFAULT_ATLAS_BUDGET / (PAGE_WIDTH * PAGE_HEIGHT);
+  hnd->glyphpacker = NR_GlyphPacker_New(PAGE_WIDTH, PAGE_HEIGHT, 1);
+  _growAtlas(hnd, 1);
+
+  // Pick up whatever we rendered with this font last time.
+  _loadCache(hnd);
 
   // Set a default size.
+  hnd->raster = NR_FONT_RASTER_BITMAP;
   NR_Font_SetResolution((void*)hnd, 0, 25);
   NR_Font_SetSize((void*)hnd, 0, 25);
 
-  // Create a shader to draw with.
-  GLuint vertexShader = loadShader(vertex_src, GL_VERTEX_SHADER);
-  GLuint geometryShader = loadShader(geometry_src, GL_GEOMETRY_SHADER);
-  GLuint fragShader = loadShader(fragment_src, GL_FRAGMENT_SHADER);
-
-  GLuint shaders[] = { vertexShader, geometryShader, fragShader };
-  hnd->program = linkProgram(shaders, 3);
-
-  glDeleteShader(vertexShader);
-  glDeleteShader(geometryShader);
-  glDeleteShader(fragShader);
+  hnd->pipeline = NR_FONT_PIPELINE_GEOMETRY;
+
+  // Uniform buffer for the palette.
+  glGenBuffers(1, &hnd->paletteUbo);
+  glBindBuffer(GL_UNIFORM_BUFFER, hnd->paletteUbo);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(hnd->palette), (void*)0, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  hnd->colorMode = NR_COLOR_MODE_RGBA;
+  hnd->paletteDirty = true;
+
+  // The atlas. Its layers are allocated when pages are first uploaded, and cleared as they're needed.
+  glGenTextures(1, &hnd->atlas);
+  NR_Renderer_BindTexture(renderer, NR_RENDERER_ATLAS_UNIT, GL_TEXTURE_2D_ARRAY, hnd->atlas);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glGenBuffers(1, &hnd->stagingBuffer);
+
+  // A texture buffer for the glyph metrics. It grows as glyphs are added.
+  glGenBuffers(1, &hnd->metricsBuffer);
+  glBindBuffer(GL_TEXTURE_BUFFER, hnd->metricsBuffer);
+  hnd->metricsBufferCapacity = 256;
+  glBufferData(GL_TEXTURE_BUFFER, sizeof(GlyphMetrics) * hnd->metricsBufferCapacity, (void*)0, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+  glGenTextures(1, &hnd->metricsTexture);
+  NR_Renderer_BindTexture(renderer, NR_RENDERER_GLYPHS_UNIT, GL_TEXTURE_BUFFER, hnd->metricsTexture);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, hnd->metricsBuffer);
+
+  // A texture to draw the grid from in one go. Cells are integers, so it can't be filtered.
+  glGenTextures(1, &hnd->gridTexture);
+  NR_Renderer_BindTexture(renderer, NR_RENDERER_CELLS_UNIT, GL_TEXTURE_2D, hnd->gridTexture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+  // Buffers to draw the grid from.
+  for (int i = 0; i < BUFFER_RING_SIZE; ++i) {
+    _createVertexBuffer(hnd, &hnd->buffers[i]);
+  }
+  hnd->frame = 1;
 
   return (void*)hnd;
 }
@@ -238,36 +809,100 @@ void NR_Font_Delete(NR_Font font) {
   // Delete the font.
   HandleType* hnd = (HandleType*)font;
 
-  // Delete the face.
+  // Keep what we've rendered for next time.
+  _saveCache(hnd);
+
+  // Stop rendering glyphs, and delete the face.
+  NR_GlyphRasterizer_Delete(hnd->rasterizer);
   FT_Done_Face(hnd->face);
+  _releaseFontData(hnd->fontData, hnd->fontCount);
 
   // Delete our glyphpacker
   NR_GlyphPacker_Delete(hnd->glyphpacker);
 
   // Delete opengl resources
-  for (int i = 0; i < PAGE_COUNT; ++i) {
-    if (hnd->pages[i]) {
-      glDeleteTextures(1, &hnd->pages[i]->texture);
-      glDeleteVertexArrays(1, &hnd->pages[i]->vao);
-      glDeleteBuffers(1, &hnd->pages[i]->vbo);
-    }
-
-    free(hnd->pages[i]);
+  glDeleteTextures(1, &hnd->atlas);
+  glDeleteBuffers(1, &hnd->stagingBuffer);
+  for (unsigned int i = 0; i < hnd->pageCount; ++i) {
+    free(hnd->pages[i].pixels);
   }
-  glDeleteProgram(hnd->program);
+  free(hnd->pages);
+  glDeleteTextures(1, &hnd->metricsTexture);
+  glDeleteTextures(1, &hnd->gridTexture);
+  glDeleteBuffers(1, &hnd->metricsBuffer);
+  for (int i = 0; i < BUFFER_RING_SIZE; ++i) {
+    glDeleteVertexArrays(1, &hnd->buffers[i].vao);
+    glDeleteVertexArrays(1, &hnd->buffers[i].instancedVao);
+    glDeleteBuffers(1, &hnd->buffers[i].vbo);
+    if (hnd->buffers[i].fence)
+      glDeleteSync(hnd->buffers[i].fence);
+  }
+
+  // The renderer may still think some of these are bound.
+  NR_Renderer_Invalidate(hnd->renderer);
+
+  // Free the grid.
+  free(hnd->vertices);
+  free(hnd->cells);
+  free(hnd->changed);
+  free(hnd->waiting);
+  free(hnd->metrics);
+  free(hnd->usage);
+  free(hnd->freeIndices);
+  free(hnd->glyphs);
+  free(hnd->prewarmRanges);
+  free(hnd->sizes);
+  glDeleteBuffers(1, &hnd->paletteUbo);
 
   // De-allocate our handle.
   free(hnd);
 }
 
+// Choose the size glyphs are drawn from. Distance fields are rendered at one size and scaled to any other,
+// bitmaps are used instead if freetype can't render them.
+static void _selectSize(HandleType* hnd) {
+  bool distanceField = hnd->raster == NR_FONT_RASTER_SDF && NR_GlyphRasterizer_HasDistanceFields();
+  int width = distanceField ? 0 : hnd->resolutionWidth;
+  int height = distanceField ? DISTANCE_FIELD_SIZE : hnd->resolutionHeight;
+
+  // Glyphs at the old size stay in the atlas until they're evicted, ready for if it changes back.
+  unsigned int sizeIndex = _sizeIndex(hnd, width, height, distanceField);
+  if (sizeIndex == hnd->sizeIndex)
+    return;
+  hnd->sizeIndex = sizeIndex;
+
+  // Render glyphs at the new size first.
+  NR_GlyphRasterizer_CancelOtherSizes(hnd->rasterizer, width, height, distanceField);
+
+  // Every cell needs to find its glyph again.
+  hnd->rebuild = true;
+
+  // Start on the glyphs we know we'll want at the new size.
+  _requestRanges(hnd);
+}
+
 // Set the resolution of each
 void NR_Font_SetResolution(NR_Font font, int width, int height) {
   HandleType* hnd = (HandleType*)font;
+
   FT_Set_Pixel_Sizes(hnd->face, width, height);
+  hnd->resolutionWidth = width;
+  hnd->resolutionHeight = height;
+  _selectSize(hnd);
+}
 
-  // Invalidate all of the pages we have cached.
-  NR_GlyphPacker_Delete(hnd->glyphpacker);
-  hnd->glyphpacker = NR_GlyphPacker_New(PAGE_WIDTH, PAGE_HEIGHT, PAGE_COUNT);
+void NR_Font_SetRaster(NR_Font font, NR_Font_Raster raster) {
+  HandleType* hnd = (HandleType*)font;
+  if (raster == hnd->raster)
+    return;
+
+  hnd->raster = raster;
+  _selectSize(hnd);
+}
+
+NR_Font_Raster NR_Font_GetRaster(NR_Font font) {
+  HandleType* hnd = (HandleType*)font;
+  return hnd->raster;
 }
 
 void NR_Font_SetSize(NR_Font font, int width, int height) {
@@ -296,263 +931,547 @@ void NR_Font_GetSize(NR_Font font, int* width, int* height) {
   *height = hnd->charHeight;
 }
 
-#undef near
-#undef far
-static void _getOrthographicProjection(float left, float right, float bottom, float top, float near, float far, float* out) {
-  out[0] = 2.0f / (right - left);
-  out[1] = 0; out[2] = 0;
-  out[3] = - (right + left) / (right - left);
-  out[4] = 0;
-  out[5] = 2.0f / (top - bottom);
-  out[6] = 0;
-  out[7] = - (top + bottom) / (top - bottom);
-  out[8] = 0; out[9] = 0;
-  out[10] = -2.0f / (far - near);
-  out[11] = (far + near) / (far - near);
-  out[12] = 0; out[13] = 0; out[14] = 0;
-  out[15] = 1;
-}
-
-static void _flush(NR_Font font, Page* page, int width, int height) {
+void NR_Font_SetAtlasBudget(NR_Font font, unsigned int bytes) {
   HandleType* hnd = (HandleType*)font;
 
-  // Enable blending.
-  glEnable(GL_BLEND);
-  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  // Always allow a page. Pages already in use are kept even if they're over.
+  hnd->maxPages = bytes / (PAGE_WIDTH * PAGE_HEIGHT);
+  if (hnd->maxPages < 1)
+    hnd->maxPages = 1;
+}
 
-  // Use our shader
-  glUseProgram(hnd->program);
+void NR_Font_Prewarm(NR_Font font, const NR_Codepoint_Range* ranges, unsigned int count) {
+  HandleType* hnd = (HandleType*)font;
 
-  // Use our texture
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, page->texture);
-  glUniform1i(glGetUniformLocation(hnd->program, "sampler"), 0);
+  hnd->prewarmRanges = realloc(hnd->prewarmRanges, sizeof(NR_Codepoint_Range) * count);
+  memcpy(hnd->prewarmRanges, ranges, sizeof(NR_Codepoint_Range) * count);
+  hnd->prewarmCount = count;
 
-  // Set our projection matrix.
-  GLfloat proj[16];
-  _getOrthographicProjection(0.0f, (float)width, (float)height, 0.0f, -1.0f, 1.0f, proj);
-  glUniformMatrix4fv(glGetUniformLocation(hnd->program, "proj"), 1, true, proj);
+  // The rasterizer ignores any it's already been asked for at this size, including those already in the atlas.
+  _requestRanges(hnd);
+}
 
-  // Set the current time (useful for effets)
-  glUniform1f(glGetUniformLocation(hnd->program, "timer"), (float)glfwGetTime());
+void NR_Font_SetPipeline(NR_Font font, NR_Font_Pipeline pipeline) {
+  HandleType* hnd = (HandleType*)font;
+  hnd->pipeline = pipeline;
+}
 
-  // Bind and draw the vertex array.
-  glBindVertexArray(page->vao);
-  glDrawArrays(GL_POINTS, 0, page->current);
-  glBindVertexArray(0);
+NR_Font_Pipeline NR_Font_GetPipeline(NR_Font font) {
+  HandleType* hnd = (HandleType*)font;
+  return hnd->pipeline;
+}
 
-  // Unbind texture
-  glBindTexture(GL_TEXTURE_2D, 0);
+void NR_Font_WaitForGlyphs(NR_Font font) {
+  HandleType* hnd = (HandleType*)font;
+  NR_GlyphRasterizer_Wait(hnd->rasterizer);
+}
 
-  // Stop using our shader
-  glUseProgram(0);
+void NR_Font_GetStats(NR_Font font, NR_Font_Stats* stats) {
+  HandleType* hnd = (HandleType*)font;
+  *stats = hnd->stats;
+}
 
-  // Reset this page.
-  page->current = 0;
+void NR_Font_SetColorMode(NR_Font font, NR_ColorMode mode) {
+  HandleType* hnd = (HandleType*)font;
+  hnd->colorMode = mode;
 }
 
-// Draw a grid of characters.
-bool NR_Font_Draw(NR_Font font, NR_Glyph* data, int dataWidth, int dataHeight, int startX, int startY, int width, int height) {
+void NR_Font_SetPalette(NR_Font font, unsigned int start, unsigned int count, const unsigned int* colors) {
   HandleType* hnd = (HandleType*)font;
+  for (unsigned int i = 0; i < count && start + i < NR_PALETTE_SIZE; ++i) {
+    hnd->palette[start + i] = colors[i];
+  }
 
-  // Where to start drawing.
-  float destX = (float)startX;
-  float destY = (float)startY;
+  // Upload it next time we draw.
+  hnd->paletteDirty = true;
+}
 
-  // The size of each cell in the grid
-  GLfloat cellWidth = (GLfloat)hnd->charWidth;
-  GLfloat cellHeight = (GLfloat)hnd->charHeight;
+static bool _glyphEqual(const NR_Glyph* a, const NR_Glyph* b) {
+  return a->codepoint == b->codepoint && a->color == b->color && a->bgColor == b->bgColor &&
+         a->flashing == b->flashing && a->bold == b->bold && a->italic == b->italic;
+}
 
-  // Loop through each item in the data we are trying to draw.
-  int totalSize = dataWidth * dataHeight;
-  for (int i = 0; i < totalSize; ++i) {
-    // Get the grid coordinates of this character.
-    int x = i % dataWidth;
-    int y = i / dataWidth;
-
-    // Get the codepoint to search for.
-    unsigned int codepoint = data[i].codepoint;
-
-    // Convert the colors to vectors.
-    unsigned int color = data[i].color;
-    unsigned int bgColor = data[i].bgColor;
-
-    Vec3d colorVec;
-    colorVec.x = (float)((color & (0xFF000000)) >> 24) / 255.0;
-    colorVec.y = (float)((color & (0x00FF0000)) >> 16) / 255.0;
-    colorVec.z = (float)((color & (0x0000FF00)) >> 8) / 255.0;
-    Vec3d bgColorVec;
-    bgColorVec.x = (float)((bgColor & (0xFF000000)) >> 24) / 255.0;
-    bgColorVec.y = (float)((bgColor & (0x00FF0000)) >> 16) / 255.0;
-    bgColorVec.z = (float)((bgColor & (0x0000FF00)) >> 8) / 255.0;
-
-    // Check if we can find this codepoint.
-    NR_GlyphPacker_Glyph glyph;
-    glyph.codepoint = codepoint;
-    bool found = NR_GlyphPacker_Find(hnd->glyphpacker, codepoint, &glyph);
-    if (!found) {
-      // We need to generate a glyph using freetype
-      // And add it to our glypmap.
-      unsigned long c = FT_Get_Char_Index(hnd->face, codepoint);
-      FT_Error err = FT_Load_Glyph(hnd->face, c, FT_LOAD_RENDER);
-      if (err != 0) return false;
-
-      // Add it to our glyphmap.
-      glyph.width = hnd->face->glyph->bitmap.width;
-      glyph.height = hnd->face->glyph->bitmap.rows;
-      glyph.advance = hnd->face->glyph->advance.x >> 6;
-      glyph.bearingX = hnd->face->glyph->bitmap_left;
-      glyph.bearingY = hnd->face->glyph->bitmap_top;
-      NR_GlyphPacker_Add(hnd->glyphpacker, &glyph);
-      found = NR_GlyphPacker_Find(hnd->glyphpacker, codepoint, &glyph);
+// Add a glyph the rasterizer has rendered to the atlas.
+static void _addGlyph(HandleType* hnd, const NR_GlyphRasterizer_Glyph* rendered) {
+  // It might already be there from the atlas cache.
+  NR_GlyphPacker_Glyph glyph;
+  const NR_GlyphRasterizer_Key* key = &rendered->key;
+  unsigned int variant = _sizeIndex(hnd, key->width, key->height, key->distanceField) * STYLE_COUNT + key->style;
+  if (NR_GlyphPacker_Find(hnd->glyphpacker, key->codepoint, variant, &glyph))
+    return;
+
+  memset(&glyph, 0, sizeof(NR_GlyphPacker_Glyph));
+  glyph.codepoint = key->codepoint;
+  glyph.variant = variant;
+  glyph.width = rendered->width;
+  glyph.height = rendered->height;
+  glyph.advance = rendered->advance;
+  glyph.bearingX = rendered->bearingX;
+  glyph.bearingY = rendered->bearingY;
+
+  // Work out where it sits in a cell once, rather than every time it's drawn.
+
+  // Get the maximum size for a glyph (in pixels)
+  // at the size it was rendered at. A zero width or height is the same as the other, as for FT_Set_Pixel_Sizes.
+  float xPpem = (float)(key->width ? key->width : key->height);
+  float yPpem = (float)(key->height ? key->height : key->width);
+  float maxWidth = ((float)(hnd->face->bbox.xMax - hnd->face->bbox.xMin) / (float)hnd->face->units_per_EM) * xPpem;
+  float maxHeight = ((float)(hnd->face->bbox.yMax - hnd->face->bbox.yMin) / (float)hnd->face->units_per_EM) * yPpem;
+  float ascender = ((float)hnd->face->ascender / (float)hnd->face->units_per_EM) * yPpem;
+
+  // Where we will put our baseline.
+  float baseline = ascender / maxHeight;
+
+  // Left and top bearing, centering the glyph horizontally.
+  float bearingX = ((maxWidth - (float)glyph.width) / 2.0f) / maxWidth;
+  float bearingY = (float)glyph.bearingY / maxHeight;
+
+  glyph.quad[0] = bearingX;
+  glyph.quad[1] = baseline - bearingY;
+  glyph.quad[2] = (float)glyph.width / maxWidth;
+  glyph.quad[3] = (float)glyph.height / maxHeight;
+
+  // Glyphs too big for a page will never fit.
+  if (glyph.width + 1 > PAGE_WIDTH || glyph.height + 1 > PAGE_HEIGHT) {
+    NR_GlyphRasterizer_MarkFailed(hnd->rasterizer, key);
+    return;
+  }
+
+  // When the atlas is full, grow it if the budget allows, otherwise make room on the least recently used page.
+  glyph.index = _newIndex(hnd);
+  bool packed = _packGlyph(hnd, &glyph, ANY_PAGE);
+  if (!packed && _growAtlas(hnd, hnd->pageCount * 2))
+    packed = _packGlyph(hnd, &glyph, ANY_PAGE);
+  if (!packed && _evictPage(hnd))
+    packed = _packGlyph(hnd, &glyph, ANY_PAGE);
+
+  if (!packed) {
+    // There's no room for it, even after evicting. Give up on it, rather than rendering it again every frame.
+    _freeIndex(hnd, glyph.index);
+    NR_GlyphRasterizer_MarkFailed(hnd->rasterizer, key);
+    return;
+  }
+
+  _blitGlyph(hnd, &glyph, rendered->bitmap, glyph.width);
+}
+
+// Upload the dirty part of each page, one transfer per page.
+static void _uploadPages(HandleType* hnd) {
+  bool bound = false;
+
+  // Resize the atlas to fit every page. It comes back blank, so every page is uploaded again from our copy.
+  if (hnd->atlasLayers != hnd->pageCount) {
+    NR_Renderer_BindTexture(hnd->renderer, NR_RENDERER_ATLAS_UNIT, GL_TEXTURE_2D_ARRAY, hnd->atlas);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RED, PAGE_WIDTH, PAGE_HEIGHT, hnd->pageCount, 0, GL_RED, GL_UNSIGNED_BYTE, (void*)0);
+    hnd->atlasLayers = hnd->pageCount;
+
+    for (unsigned int i = 0; i < hnd->pageCount; ++i) {
+      if (hnd->pages[i].pixels)
+        _dirtyPage(&hnd->pages[i]);
+    }
+  }
+
+  for (unsigned int i = 0; i < hnd->pageCount; ++i) {
+    Page* page = &hnd->pages[i];
+    if (!page->dirty)
+      continue;
+
+    // Empty glyphs (spaces) still make a page dirty.
+    unsigned int width = page->dirtyX1 - page->dirtyX0;
+    unsigned int height = page->dirtyY1 - page->dirtyY0;
+    if (width == 0 || height == 0) {
+      page->dirty = false;
+      continue;
+    }
 
+    if (!bound) {
       // Disable byte alignment restrictions for this
       // since our textures are only 8bit color!
       glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+      NR_Renderer_BindTexture(hnd->renderer, NR_RENDERER_ATLAS_UNIT, GL_TEXTURE_2D_ARRAY, hnd->atlas);
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, hnd->stagingBuffer);
+      bound = true;
+    }
 
-      // Add it to our texture
-      if (!hnd->pages[glyph.page]) {
-        // Allocate memory for a page.
-        hnd->pages[glyph.page] = malloc(sizeof(Page));
-        memset(hnd->pages[glyph.page], 0, sizeof(Page));
-
-        // Create a texture for this page.
-        GLuint texId;
-        glGenTextures(1, &texId);
-        hnd->pages[glyph.page]->texture = texId;
-
-        // Bind it
-        glBindTexture(GL_TEXTURE_2D, texId);
-
-        // Allocate the texture memory.
-        unsigned char data[PAGE_WIDTH * PAGE_HEIGHT];
-        memset(data, 0, PAGE_WIDTH * PAGE_HEIGHT);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, PAGE_WIDTH, PAGE_HEIGHT, 0, GL_RED, GL_UNSIGNED_BYTE, (void*)data);
-
-        // Texture options
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        // Unbind
-        glBindTexture(GL_TEXTURE_2D, 0);
-
-        // Create a vertex buffer for this page.
-        glGenVertexArrays(1, &hnd->pages[glyph.page]->vao);
-        glGenBuffers(1, &hnd->pages[glyph.page]->vbo);
-        glBindVertexArray(hnd->pages[glyph.page]->vao);
-        glBindBuffer(GL_ARRAY_BUFFER, hnd->pages[glyph.page]->vbo);
-
-        // Data
-        glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * MAX_VERTICES_PER_FLUSH, (void*)0, GL_DYNAMIC_DRAW);
-
-        // Specify the buffer format...
-        GLint colorAttrib = glGetAttribLocation(hnd->program, "vColor");
-        glEnableVertexAttribArray(colorAttrib);
-        glVertexAttribPointer(colorAttrib, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, color));
-
-        GLint bgColorAttrib = glGetAttribLocation(hnd->program, "vBgColor");
-        glEnableVertexAttribArray(bgColorAttrib);
-        glVertexAttribPointer(bgColorAttrib, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, bgColor));
-
-        GLint glyphRectAttrib = glGetAttribLocation(hnd->program, "vGlyphRect");
-        glEnableVertexAttribArray(glyphRectAttrib);
-        glVertexAttribPointer(glyphRectAttrib, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, glyphRect));
-
-        GLint textureRectAttrib = glGetAttribLocation(hnd->program, "vTextureRect");
-        glEnableVertexAttribArray(textureRectAttrib);
-        glVertexAttribPointer(textureRectAttrib, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, textureRect));
-
-        GLint bgRectAttrib = glGetAttribLocation(hnd->program, "vBgRect");
-        glEnableVertexAttribArray(bgRectAttrib);
-        glVertexAttribPointer(bgRectAttrib, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, bgRect));
-
-        GLint flagsAttrib = glGetAttribLocation(hnd->program, "vFlags");
-        glEnableVertexAttribArray(flagsAttrib);
-        glVertexAttribIPointer(flagsAttrib, 1, GL_UNSIGNED_BYTE, sizeof(Vertex), (void*)offsetof(Vertex, flags));
-
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindVertexArray(0);
-      }
+    // Copy the rect into fresh staging memory, so we don't wait on the last transfer out of it.
+    GLsizeiptr size = width * height;
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, size, (void*)0, GL_STREAM_DRAW);
+    unsigned char* staging = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (!staging)
+      continue;
+
+    for (unsigned int y = 0; y < height; ++y) {
+      memcpy(staging + y * width, page->pixels + (page->dirtyY0 + y) * PAGE_WIDTH + page->dirtyX0, width);
+    }
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, page->dirtyX0, page->dirtyY0, i, width, height, 1, GL_RED, GL_UNSIGNED_BYTE, (void*)0);
+    page->dirty = false;
+    hnd->stats.atlasUploads++;
+  }
+
+  if (bound)
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+// Add whatever the rasterizer has finished since last time, returning how many glyphs came back.
+static unsigned int _receiveGlyphs(HandleType* hnd) {
+  unsigned int received = 0;
+
+  NR_GlyphRasterizer_Glyph rendered;
+  while (received < GLYPHS_PER_DRAW && NR_GlyphRasterizer_Receive(hnd->rasterizer, &rendered)) {
+    if (rendered.rendered)
+      _addGlyph(hnd, &rendered);
+
+    NR_GlyphRasterizer_FreeGlyph(&rendered);
+    received++;
+  }
+
+  // Upload them all at once.
+  _uploadPages(hnd);
+
+  return received;
+}
+
+// Find a glyph in the atlas at the current resolution. If it isn't there yet it's queued to be rendered,
+// and waiting is set if it's still to come.
+static bool _findGlyph(HandleType* hnd, unsigned int codepoint, unsigned int style, NR_GlyphPacker_Glyph* glyph, bool* waiting) {
+  *waiting = false;
+  unsigned int variant = hnd->sizeIndex * STYLE_COUNT + style;
+  if (NR_GlyphPacker_Find(hnd->glyphpacker, codepoint, variant, glyph))
+    return true;
+
+  NR_GlyphRasterizer_Key key = _glyphKey(hnd, codepoint, variant);
+  *waiting = NR_GlyphRasterizer_Request(hnd->rasterizer, &key);
+  return false;
+}
 
-      // Either we managed to generate one, or there was already one generated.
-      if (hnd->pages[glyph.page]) {
-        // Bind the texture, and blit the image onto it.
-        glBindTexture(GL_TEXTURE_2D, hnd->pages[glyph.page]->texture);
-        glTexSubImage2D(GL_TEXTURE_2D, 0, glyph.x, glyph.y, glyph.width, glyph.height, GL_RED, GL_UNSIGNED_BYTE, hnd->face->glyph->bitmap.buffer);
-        glBindTexture(GL_TEXTURE_2D, 0);
+// Count a cell drawing the glyph in a vertex, or one that's stopped drawing it.
+static void _useGlyph(HandleType* hnd, GLuint glyph) {
+  glyph &= VERTEX_GLYPH_MASK;
+  if (glyph == NO_GLYPH)
+    return;
+
+  hnd->usage[glyph].cells++;
+  hnd->usage[glyph].lastUsed = hnd->frame;
+  hnd->pages[hnd->usage[glyph].page].cells++;
+}
+
+static void _releaseGlyph(HandleType* hnd, GLuint glyph) {
+  glyph &= VERTEX_GLYPH_MASK;
+  if (glyph == NO_GLYPH)
+    return;
+
+  hnd->usage[glyph].cells--;
+  hnd->usage[glyph].lastUsed = hnd->frame;
+  hnd->pages[hnd->usage[glyph].page].cells--;
+}
+
+// Build the vertex for the cell at x, y. Returns whether it's waiting for its glyph.
+static bool _buildVertex(HandleType* hnd, Vertex* vertex, const NR_Glyph* cell, int x, int y) {
+  vertex->x = (GLushort)x;
+  vertex->y = (GLushort)y;
+  vertex->color = cell->color;
+  vertex->bgColor = cell->bgColor;
+
+  // Without a glyph only the background gets drawn, including while it's still being rendered.
+  NR_GlyphPacker_Glyph glyph;
+  bool waiting;
+  unsigned int style = (cell->bold ? NR_GLYPH_STYLE_BOLD : 0) | (cell->italic ? NR_GLYPH_STYLE_ITALIC : 0);
+  vertex->glyph = _findGlyph(hnd, cell->codepoint, style, &glyph, &waiting) ? glyph.index : NO_GLYPH;
+
+  if (cell->flashing)
+    vertex->glyph |= VERTEX_FLAGS_FLASHING << VERTEX_FLAGS_SHIFT;
+
+  return waiting;
+}
+
+// Make sure the grid is the right size, starting from scratch if it isn't.
+static void _resizeGrid(HandleType* hnd, int dataWidth, int dataHeight, int startX, int startY) {
+  if (dataWidth != hnd->gridWidth || dataHeight != hnd->gridHeight) {
+    int cellCount = dataWidth * dataHeight;
+    hnd->vertices = realloc(hnd->vertices, sizeof(Vertex) * cellCount);
+    hnd->cells = realloc(hnd->cells, sizeof(NR_Glyph) * cellCount);
+    hnd->changed = realloc(hnd->changed, sizeof(unsigned int) * cellCount);
+    hnd->waiting = realloc(hnd->waiting, sizeof(bool) * cellCount);
+    hnd->gridWidth = dataWidth;
+    hnd->gridHeight = dataHeight;
+    hnd->rebuild = true;
+  }
+
+  // Cells are positioned by the shaders, so moving the grid doesn't need a rebuild.
+  hnd->gridX = startX;
+  hnd->gridY = startY;
+}
+
+// Find the next run of cells that have changed since frame, from *next on, taking in any runs after it that
+// are close enough to upload along with it. Returns false if there are no more.
+static bool _nextChangedRun(HandleType* hnd, unsigned int frame, unsigned int cellCount, unsigned int* next,
+                            unsigned int* start, unsigned int* end) {
+  unsigned int i = *next;
+  while (i < cellCount && hnd->changed[i] <= frame)
+    ++i;
+  if (i == cellCount)
+    return false;
+
+  *start = i;
+  *end = i;
+  while (i < cellCount && i - *end < UPLOAD_MERGE_GAP) {
+    if (hnd->changed[i] > frame)
+      *end = i + 1;
+    ++i;
+  }
+
+  *next = *end;
+  return true;
+}
+
+// Bring the next buffer in the ring up to date, returning it.
+static VertexBuffer* _upload(HandleType* hnd) {
+  // Move on to the next buffer in the ring.
+  hnd->currentBuffer = (hnd->currentBuffer + 1) % BUFFER_RING_SIZE;
+  VertexBuffer* buffer = &hnd->buffers[hnd->currentBuffer];
+
+  unsigned int cellCount = hnd->gridWidth * hnd->gridHeight;
+  GLsizeiptr size = sizeof(Vertex) * cellCount;
+
+  // Check whether the GPU has finished with this buffer, without waiting for it.
+  bool idle = true;
+  if (buffer->fence) {
+    GLenum status = glClientWaitSync(buffer->fence, 0, 0);
+    idle = status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, buffer->vbo);
+
+  // See how many runs of cells have changed since this buffer was last used, if we can use it.
+  bool everything = !idle || size != buffer->size;
+  unsigned int runs = 0, cells = 0, next = 0, start, end;
+  while (!everything && _nextChangedRun(hnd, buffer->frame, cellCount, &next, &start, &end)) {
+    runs++;
+    cells += end - start;
+    everything = runs > MAX_UPLOAD_RUNS || (float)cells > MAX_UPLOAD_FRACTION * (float)cellCount;
+  }
+
+  if (everything) {
+    // The grid's changed size, the GPU is still using it, or too much has changed to be worth writing in
+    // pieces. Upload everything into fresh memory rather than waiting.
+    buffer->size = size;
+    glBufferData(GL_ARRAY_BUFFER, size, hnd->vertices, GL_DYNAMIC_DRAW);
+    hnd->stats.cellsUploaded += cellCount;
+    hnd->stats.cellUploads++;
+  } else {
+    // Only write the runs of cells that have changed.
+    next = 0;
+    while (_nextChangedRun(hnd, buffer->frame, cellCount, &next, &start, &end)) {
+      glBufferSubData(GL_ARRAY_BUFFER, sizeof(Vertex) * start, sizeof(Vertex) * (end - start), hnd->vertices + start);
+      hnd->stats.cellsUploaded += end - start;
+      hnd->stats.cellUploads++;
+    }
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  buffer->frame = hnd->frame;
+  return buffer;
+}
+
+// Whether any cell in a row has changed since frame.
+static bool _rowChanged(HandleType* hnd, int y, unsigned int frame) {
+  unsigned int* changed = hnd->changed + y * hnd->gridWidth;
+  for (int x = 0; x < hnd->gridWidth; ++x) {
+    if (changed[x] > frame)
+      return true;
+  }
+
+  return false;
+}
+
+// Bring the grid texture up to date, uploading the rows with cells that have changed since it was last used.
+static void _uploadGridTexture(HandleType* hnd) {
+  NR_Renderer_BindTexture(hnd->renderer, NR_RENDERER_CELLS_UNIT, GL_TEXTURE_2D, hnd->gridTexture);
+
+  if (hnd->gridWidth != hnd->gridTextureWidth || hnd->gridHeight != hnd->gridTextureHeight) {
+    // The grid's changed size, upload everything.
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32UI, hnd->gridWidth, hnd->gridHeight, 0, GL_RGBA_INTEGER, GL_UNSIGNED_INT, hnd->vertices);
+    hnd->gridTextureWidth = hnd->gridWidth;
+    hnd->gridTextureHeight = hnd->gridHeight;
+    hnd->stats.cellsUploaded += hnd->gridWidth * hnd->gridHeight;
+    hnd->stats.cellUploads++;
+  } else {
+    // Only upload runs of rows that have changed.
+    int y = 0;
+    while (y < hnd->gridHeight) {
+      if (!_rowChanged(hnd, y, hnd->gridTextureFrame)) {
+        ++y;
+        continue;
       }
+
+      int start = y;
+      while (y < hnd->gridHeight && _rowChanged(hnd, y, hnd->gridTextureFrame))
+        ++y;
+
+      glTexSubImage2D(GL_TEXTURE_2D, 0, 0, start, hnd->gridWidth, y - start, GL_RGBA_INTEGER, GL_UNSIGNED_INT, hnd->vertices + start * hnd->gridWidth);
+      hnd->stats.cellsUploaded += (y - start) * hnd->gridWidth;
+      hnd->stats.cellUploads++;
     }
+  }
+
+  hnd->gridTextureFrame = hnd->frame;
+}
+
+static void _flush(NR_Font font, int width, int height) {
+  HandleType* hnd = (HandleType*)font;
+  unsigned int cellCount = hnd->gridWidth * hnd->gridHeight;
+
+  // Set up projection, timer and blending. Anything already set is left alone.
+  NR_Renderer_Begin(hnd->renderer, width, height);
 
-    // We already have this glyph in our atlas..
-    if (found) {
-      Page* curPage = hnd->pages[glyph.page];
-
-      // If we've gone over our maximum, flush first so we can draw some more!
-      if (curPage->current >= MAX_VERTICES_PER_FLUSH)
-        _flush(font, curPage, width, height);
-
-      // Get the rect for this glyph on the texture.
-      GLfloat glyphStartTexX = (GLfloat)glyph.x / (GLfloat)PAGE_WIDTH;
-      GLfloat glyphStartTexY = (GLfloat)glyph.y / (GLfloat)PAGE_HEIGHT;
-      GLfloat glyphEndTexX = glyphStartTexX + (GLfloat)glyph.width / (GLfloat)PAGE_WIDTH;
-      GLfloat glyphEndTexY = glyphStartTexY + (GLfloat)glyph.height / (GLfloat)PAGE_HEIGHT;
-
-      // Now get the rect to for the size of the glyph.
-
-      // Get the maximum size for a glyph (in pixels)
-      GLfloat maxWidth = ((GLfloat)(hnd->face->bbox.xMax - hnd->face->bbox.xMin) / (GLfloat)hnd->face->units_per_EM) * (GLfloat)hnd->face->size->metrics.x_ppem;
-      GLfloat maxHeight = ((GLfloat)(hnd->face->bbox.yMax - hnd->face->bbox.yMin) / (GLfloat)hnd->face->units_per_EM) * (GLfloat)hnd->face->size->metrics.y_ppem;
-      GLfloat ascender = ((GLfloat)hnd->face->ascender / (GLfloat)hnd->face->units_per_EM) * (GLfloat)hnd->face->size->metrics.y_ppem;
-
-      // Where we will put our baseline.
-      GLfloat baseline = ascender / maxHeight;
-
-      // Left and top bearing
-      GLfloat bearingX = ((maxWidth - (GLfloat)glyph.width) / 2.0f) / maxWidth;
-      GLfloat bearingY = (GLfloat)glyph.bearingY / maxHeight;
-
-      GLfloat glyphWidth = (GLfloat)glyph.width / maxWidth;
-      GLfloat glyphHeight = (GLfloat)glyph.height / maxHeight;
-
-      // The start pos of this glyph
-      GLfloat startX = destX + ((float)x + bearingX) * cellWidth;
-      GLfloat startY = destY + ((float)y + baseline - bearingY) * cellHeight;
-      GLfloat endX = startX + glyphWidth * cellWidth;
-      GLfloat endY = startY + glyphHeight * cellHeight;
-
-      // First Vertex.
-      Vertex vertex;
-      vertex.color = colorVec;
-      vertex.bgColor = bgColorVec;
-      vertex.glyphRect = (Vec4d) { startX, startY,
-                                   endX, endY };
-      vertex.textureRect = (Vec4d) { glyphStartTexX, glyphStartTexY,
-                                   glyphEndTexX, glyphEndTexY };
-      vertex.bgRect = (Vec4d) { destX + cellWidth * x, destY + cellHeight * y,
-                                destX + cellWidth * (x+1), destY + cellHeight * (y+1) };
-
-      vertex.flags = 0;
-      if (data[i].flashing)
-        vertex.flags |= VERTEX_FLAGS_FLASHING;
-
-      // Map the vertex buffer and add vertex data at the correct location.
-      glBindBuffer(GL_ARRAY_BUFFER, curPage->vbo);
-      glBufferSubData(GL_ARRAY_BUFFER, curPage->current * sizeof(Vertex), sizeof(Vertex), &vertex);
-      glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-      // We've added a vertex.
-      curPage->current += 1;
+  // Bring whatever we're drawing from up to date.
+  VertexBuffer* buffer = (void*)0;
+  if (hnd->pipeline == NR_FONT_PIPELINE_GRID_TEXTURE) {
+    _uploadGridTexture(hnd);
+  } else {
+    buffer = _upload(hnd);
+  }
+
+  // Use our shader, atlas and glyph metrics.
+  static const NR_Renderer_Program programs[] = {
+    NR_RENDERER_PROGRAM_GEOMETRY,     // NR_FONT_PIPELINE_GEOMETRY
+    NR_RENDERER_PROGRAM_INSTANCED,    // NR_FONT_PIPELINE_INSTANCED
+    NR_RENDERER_PROGRAM_GRID_TEXTURE  // NR_FONT_PIPELINE_GRID_TEXTURE
+  };
+  NR_Renderer_UseProgram(hnd->renderer, programs[hnd->pipeline]);
+  NR_Renderer_BindTexture(hnd->renderer, NR_RENDERER_ATLAS_UNIT, GL_TEXTURE_2D_ARRAY, hnd->atlas);
+  NR_Renderer_BindTexture(hnd->renderer, NR_RENDERER_GLYPHS_UNIT, GL_TEXTURE_BUFFER, hnd->metricsTexture);
+
+  // Where the grid is.
+  NR_Renderer_SetGrid(hnd->renderer, (float)hnd->gridX, (float)hnd->gridY, (float)hnd->charWidth, (float)hnd->charHeight);
+
+  // Palette.
+  NR_Renderer_SetPaletteMode(hnd->renderer, hnd->colorMode == NR_COLOR_MODE_PALETTE);
+  NR_Renderer_BindUniformBuffer(hnd->renderer, NR_RENDERER_PALETTE_BINDING, hnd->paletteUbo);
+
+  // Draw the whole grid in one go, each cell's background then its glyph.
+  switch (hnd->pipeline) {
+    case NR_FONT_PIPELINE_GEOMETRY:
+      NR_Renderer_BindVertexArray(hnd->renderer, buffer->vao);
+      glDrawArrays(GL_POINTS, 0, cellCount);
+      break;
+
+    case NR_FONT_PIPELINE_INSTANCED:
+      NR_Renderer_BindVertexArray(hnd->renderer, buffer->instancedVao);
+      glDrawArraysInstanced(GL_TRIANGLES, 0, 12, cellCount);
+      break;
+
+    case NR_FONT_PIPELINE_GRID_TEXTURE:
+      NR_Renderer_BindVertexArray(hnd->renderer, NR_Renderer_GetEmptyVertexArray(hnd->renderer));
+      glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+      break;
+  }
+
+  // Mark when the GPU is done with this buffer.
+  if (buffer) {
+    if (buffer->fence)
+      glDeleteSync(buffer->fence);
+    buffer->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+}
+
+// Draw a grid of characters.
+bool NR_Font_Draw(NR_Font font, NR_Glyph* data, int dataWidth, int dataHeight, int startX, int startY, int width, int height) {
+  HandleType* hnd = (HandleType*)font;
+
+  // Upload the palette if it's changed.
+  if (hnd->paletteDirty) {
+    glBindBuffer(GL_UNIFORM_BUFFER, hnd->paletteUbo);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(hnd->palette), hnd->palette);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    hnd->paletteDirty = false;
+  }
+
+  _resizeGrid(hnd, dataWidth, dataHeight, startX, startY);
+
+  // A new frame.
+  hnd->frame++;
+  hnd->stats.cellsRebuilt = 0;
+  hnd->stats.cellsUploaded = 0;
+  hnd->stats.cellUploads = 0;
+  hnd->stats.cellsWaiting = 0;
+  hnd->stats.atlasUploads = 0;
+  hnd->stats.glyphsEvicted = 0;
+  hnd->stats.pagesEvicted = 0;
+
+  // Add any glyphs that have been rendered since last time.
+  bool received = _receiveGlyphs(hnd) > 0;
+
+  // Save the atlas once it's settled, rather than only when the font's deleted, so it isn't lost if we never are.
+  time_t now = time((void*)0);
+  if (received) {
+    hnd->cacheChangedAt = now;
+  } else if (hnd->cacheDirty && difftime(now, hnd->cacheChangedAt) >= CACHE_SAVE_DELAY) {
+    _saveCache(hnd);
+    hnd->cacheChangedAt = now;
+  }
+
+  // Every cell is about to find its glyph again, so start counting from nothing.
+  if (hnd->rebuild) {
+    for (unsigned int i = 0; i < hnd->metricsCount; ++i) {
+      hnd->usage[i].cells = 0;
+    }
+    for (unsigned int i = 0; i < hnd->pageCount; ++i) {
+      hnd->pages[i].cells = 0;
     }
   }
 
-  // Do a final flush for each page.
-  for (int i = 0; i < PAGE_COUNT; ++i) {
-    if (hnd->pages[i]) {
-      _flush(font, hnd->pages[i], width, height);
+  // Rebuild the vertex for each cell that's changed since last time, or that might have its glyph now.
+  int totalSize = dataWidth * dataHeight;
+  for (int i = 0; i < totalSize; ++i) {
+    if (!hnd->rebuild && !(received && hnd->waiting[i]) && _glyphEqual(&data[i], &hnd->cells[i])) {
+      hnd->stats.cellsWaiting += hnd->waiting[i];
+      continue;
     }
+
+    if (!hnd->rebuild)
+      _releaseGlyph(hnd, hnd->vertices[i].glyph);
+
+    hnd->waiting[i] = _buildVertex(hnd, &hnd->vertices[i], &data[i], i % dataWidth, i / dataWidth);
+    _useGlyph(hnd, hnd->vertices[i].glyph);
+    hnd->stats.cellsWaiting += hnd->waiting[i];
+    hnd->cells[i] = data[i];
+    hnd->changed[i] = hnd->frame;
+    hnd->stats.cellsRebuilt++;
+  }
+  hnd->rebuild = false;
+
+  // Pages with glyphs on screen have been used this frame.
+  for (unsigned int i = 0; i < hnd->pageCount; ++i) {
+    if (hnd->pages[i].cells > 0)
+      hnd->pages[i].lastUsed = hnd->frame;
   }
+  hnd->stats.atlasPages = hnd->pageCount;
+
+  // Upload the metrics of any glyphs added this frame.
+  if (hnd->metricsUploaded < hnd->metricsCount) {
+    glBindBuffer(GL_TEXTURE_BUFFER, hnd->metricsBuffer);
+    if (hnd->metricsCount > hnd->metricsBufferCapacity) {
+      // Grow the buffer, re-uploading everything.
+      hnd->metricsBufferCapacity = hnd->metricsCapacity;
+      glBufferData(GL_TEXTURE_BUFFER, sizeof(GlyphMetrics) * hnd->metricsBufferCapacity, (void*)0, GL_DYNAMIC_DRAW);
+      hnd->metricsUploaded = 0;
+    }
+    glBufferSubData(GL_TEXTURE_BUFFER, sizeof(GlyphMetrics) * hnd->metricsUploaded,
+                    sizeof(GlyphMetrics) * (hnd->metricsCount - hnd->metricsUploaded), hnd->metrics + hnd->metricsUploaded);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    hnd->metricsUploaded = hnd->metricsCount;
+  }
+
+  // Nothing to draw.
+  if (totalSize == 0)
+    return true;
+
+  // Upload the changes and draw.
+  _flush(font, width, height);
 
   return true;
 }
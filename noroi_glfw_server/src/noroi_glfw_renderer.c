@@ -0,0 +1,328 @@
+#include <noroi/glfw_server/noroi_glfw_renderer.h>
+
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+// Include shaders.
+#include <noroi/glfw_server/shaders/fragment.h>
+#include <noroi/glfw_server/shaders/geometry.h>
+#include <noroi/glfw_server/shaders/grid_fragment.h>
+#include <noroi/glfw_server/shaders/grid_vertex.h>
+#include <noroi/glfw_server/shaders/instanced.h>
+#include <noroi/glfw_server/shaders/vertex.h>
+
+#define UNKNOWN ((GLuint)-1)
+
+// A linked program, and the locations of its uniforms.
+typedef struct {
+  GLuint program;
+  GLint paletteModeLocation;
+  int paletteMode; // The last value given to paletteMode, or -1 if unknown.
+  GLint gridLocation;
+  GLfloat grid[4];
+} Program;
+
+// The frame uniform block, laid out std140.
+typedef struct {
+  GLfloat proj[16];
+  GLfloat timer;
+  GLfloat padding[3];
+} FrameUniforms;
+
+// Internal representation of NR_Renderer
+typedef struct {
+  Program programs[NR_RENDERER_PROGRAM_COUNT];
+
+  // Uniform buffer for the projection and timer, and the size the projection was built for.
+  GLuint frameUbo;
+  int width, height;
+
+  // An empty vertex array.
+  GLuint emptyVao;
+
+  // What's currently bound, UNKNOWN if it could be anything.
+  bool blendSet;
+  int currentProgram;
+  GLuint currentVao;
+  GLuint currentTextures[NR_RENDERER_UNIT_COUNT];
+  GLuint activeUnit;
+  GLuint currentUniformBuffers[2];
+} HandleType;
+
+// Utility function for loading a shader.
+static GLuint _loadShader(const char* source, GLenum type) {
+  // Create a shader to draw with.
+  GLuint shader = glCreateShader(type);
+  glShaderSource(shader, 1, (const GLchar**)&source, (void*)0);
+  glCompileShader(shader);
+
+  printf("Compiling shader: %s\n", source);
+
+  // Compile it.
+  GLint success;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+  if (success == GL_FALSE) {
+    GLint maxLength = 0;
+  	glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &maxLength);
+
+    // Allocate space for log.
+    char* log = malloc(sizeof(char) * maxLength);
+
+    // Get name of shader type.
+    const char* shaderTypeString;
+    if (type == GL_GEOMETRY_SHADER) shaderTypeString = "geometry";
+    if (type == GL_VERTEX_SHADER) shaderTypeString = "vertex";
+    if (type == GL_FRAGMENT_SHADER) shaderTypeString = "fragment";
+
+    glGetShaderInfoLog(shader, sizeof(char) * maxLength, &maxLength, log);
+    printf("Error compiling %s shader: %s\n", shaderTypeString, log);
+
+    // Free log
+    free(log);
+
+    return 0;
+  }
+
+  return shader;
+}
+
+// Link shaders together into a single program.
+static GLuint _linkProgram(GLuint* shaders, int count) {
+  // Create the program, attache the shaders and link the program.
+  GLuint program = glCreateProgram();
+  for (int i = 0; i < count; ++i) {
+    glAttachShader(program, shaders[i]);
+  }
+
+  // Fix the attribute locations so that a vertex array can be described without the program.
+  glBindAttribLocation(program, NR_RENDERER_ATTRIB_CELL, "vCell");
+  glBindAttribLocation(program, NR_RENDERER_ATTRIB_GLYPH, "vGlyph");
+  glBindAttribLocation(program, NR_RENDERER_ATTRIB_COLOR, "vColor");
+  glBindAttribLocation(program, NR_RENDERER_ATTRIB_BG_COLOR, "vBgColor");
+
+  glLinkProgram(program);
+
+  // Get the status of the linking.
+  GLint success;
+  GLchar log[512];
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  if (!success) {
+    glGetProgramInfoLog(program, sizeof(log), (void*)0, log);
+    printf("Font shader link error:\n %s\n", log);
+    return 0;
+  }
+
+  return program;
+}
+
+#undef near
+#undef far
+static void _getOrthographicProjection(float left, float right, float bottom, float top, float near, float far, float* out) {
+  out[0] = 2.0f / (right - left);
+  out[1] = 0; out[2] = 0;
+  out[3] = - (right + left) / (right - left);
+  out[4] = 0;
+  out[5] = 2.0f / (top - bottom);
+  out[6] = 0;
+  out[7] = - (top + bottom) / (top - bottom);
+  out[8] = 0; out[9] = 0;
+  out[10] = -2.0f / (far - near);
+  out[11] = (far + near) / (far - near);
+  out[12] = 0; out[13] = 0; out[14] = 0;
+  out[15] = 1;
+}
+
+// Set up a linked program's fixed uniforms and cache its uniform locations.
+static void _initProgram(Program* program, GLuint linked) {
+  program->program = linked;
+  program->paletteModeLocation = glGetUniformLocation(linked, "paletteMode");
+  program->paletteMode = -1;
+  program->gridLocation = glGetUniformLocation(linked, "grid");
+  memset(program->grid, 0, sizeof(program->grid));
+
+  // Uniform blocks.
+  GLuint paletteIndex = glGetUniformBlockIndex(linked, "Palette");
+  if (paletteIndex != GL_INVALID_INDEX)
+    glUniformBlockBinding(linked, paletteIndex, NR_RENDERER_PALETTE_BINDING);
+  GLuint frameIndex = glGetUniformBlockIndex(linked, "Frame");
+  if (frameIndex != GL_INVALID_INDEX)
+    glUniformBlockBinding(linked, frameIndex, NR_RENDERER_FRAME_BINDING);
+
+  // Textures are always on the same units.
+  glUseProgram(linked);
+  glUniform1i(glGetUniformLocation(linked, "sampler"), NR_RENDERER_ATLAS_UNIT);
+  glUniform1i(glGetUniformLocation(linked, "glyphs"), NR_RENDERER_GLYPHS_UNIT);
+  glUniform1i(glGetUniformLocation(linked, "cells"), NR_RENDERER_CELLS_UNIT);
+  glUseProgram(0);
+}
+
+NR_Renderer NR_Renderer_New() {
+  HandleType* hnd = malloc(sizeof(HandleType));
+  memset(hnd, 0, sizeof(HandleType));
+
+  // Load all of our shaders.
+  GLuint vertexShader = _loadShader(vertex_src, GL_VERTEX_SHADER);
+  GLuint geometryShader = _loadShader(geometry_src, GL_GEOMETRY_SHADER);
+  GLuint instancedShader = _loadShader(instanced_src, GL_VERTEX_SHADER);
+  GLuint fragShader = _loadShader(fragment_src, GL_FRAGMENT_SHADER);
+  GLuint gridVertexShader = _loadShader(grid_vertex_src, GL_VERTEX_SHADER);
+  GLuint gridFragShader = _loadShader(grid_fragment_src, GL_FRAGMENT_SHADER);
+
+  // A program to expand points with a geometry shader.
+  GLuint geometryShaders[] = { vertexShader, geometryShader, fragShader };
+  _initProgram(&hnd->programs[NR_RENDERER_PROGRAM_GEOMETRY], _linkProgram(geometryShaders, 3));
+
+  // And one to draw instanced quads with, without a geometry shader.
+  GLuint instancedShaders[] = { instancedShader, fragShader };
+  _initProgram(&hnd->programs[NR_RENDERER_PROGRAM_INSTANCED], _linkProgram(instancedShaders, 2));
+
+  // And one that draws the grid as a single quad, looking cells up in a texture.
+  GLuint gridShaders[] = { gridVertexShader, gridFragShader };
+  _initProgram(&hnd->programs[NR_RENDERER_PROGRAM_GRID_TEXTURE], _linkProgram(gridShaders, 2));
+
+  glDeleteShader(vertexShader);
+  glDeleteShader(geometryShader);
+  glDeleteShader(instancedShader);
+  glDeleteShader(fragShader);
+  glDeleteShader(gridVertexShader);
+  glDeleteShader(gridFragShader);
+
+  // A vertex array without any attributes, for drawing things made up in the vertex shader.
+  glGenVertexArrays(1, &hnd->emptyVao);
+
+  // Uniform buffer for the projection and timer.
+  glGenBuffers(1, &hnd->frameUbo);
+  glBindBuffer(GL_UNIFORM_BUFFER, hnd->frameUbo);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), (void*)0, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+  // Nothing's bound yet.
+  NR_Renderer_Invalidate((void*)hnd);
+
+  return (void*)hnd;
+}
+
+void NR_Renderer_Delete(NR_Renderer renderer) {
+  HandleType* hnd = (HandleType*)renderer;
+
+  for (int i = 0; i < NR_RENDERER_PROGRAM_COUNT; ++i) {
+    glDeleteProgram(hnd->programs[i].program);
+  }
+  glDeleteBuffers(1, &hnd->frameUbo);
+  glDeleteVertexArrays(1, &hnd->emptyVao);
+
+  free(hnd);
+}
+
+void NR_Renderer_Begin(NR_Renderer renderer, int width, int height) {
+  HandleType* hnd = (HandleType*)renderer;
+
+  // Enable blending the first time round, or after being invalidated.
+  if (!hnd->blendSet) {
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    hnd->blendSet = true;
+  }
+
+  glBindBuffer(GL_UNIFORM_BUFFER, hnd->frameUbo);
+
+  // Only rebuild the projection when the size changes.
+  if (width != hnd->width || height != hnd->height) {
+    GLfloat proj[16];
+    _getOrthographicProjection(0.0f, (float)width, (float)height, 0.0f, -1.0f, 1.0f, proj);
+    glBufferSubData(GL_UNIFORM_BUFFER, offsetof(FrameUniforms, proj), sizeof(proj), proj);
+
+    hnd->width = width;
+    hnd->height = height;
+  }
+
+  // Set the current time (useful for effets)
+  GLfloat timer = (GLfloat)glfwGetTime();
+  glBufferSubData(GL_UNIFORM_BUFFER, offsetof(FrameUniforms, timer), sizeof(timer), &timer);
+
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+  NR_Renderer_BindUniformBuffer(renderer, NR_RENDERER_FRAME_BINDING, hnd->frameUbo);
+}
+
+void NR_Renderer_UseProgram(NR_Renderer renderer, NR_Renderer_Program program) {
+  HandleType* hnd = (HandleType*)renderer;
+  if (hnd->currentProgram != (int)program) {
+    glUseProgram(hnd->programs[program].program);
+    hnd->currentProgram = program;
+  }
+}
+
+void NR_Renderer_BindVertexArray(NR_Renderer renderer, GLuint vao) {
+  HandleType* hnd = (HandleType*)renderer;
+  if (hnd->currentVao != vao) {
+    glBindVertexArray(vao);
+    hnd->currentVao = vao;
+  }
+}
+
+void NR_Renderer_BindTexture(NR_Renderer renderer, GLuint unit, GLenum target, GLuint texture) {
+  HandleType* hnd = (HandleType*)renderer;
+  // Leave the unit active, so that the texture can be modified afterwards.
+  if (hnd->activeUnit != unit) {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    hnd->activeUnit = unit;
+  }
+
+  if (hnd->currentTextures[unit] != texture) {
+    glBindTexture(target, texture);
+    hnd->currentTextures[unit] = texture;
+  }
+}
+
+void NR_Renderer_BindUniformBuffer(NR_Renderer renderer, GLuint binding, GLuint buffer) {
+  HandleType* hnd = (HandleType*)renderer;
+  if (hnd->currentUniformBuffers[binding] != buffer) {
+    glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer);
+    hnd->currentUniformBuffers[binding] = buffer;
+  }
+}
+
+void NR_Renderer_SetPaletteMode(NR_Renderer renderer, bool paletteMode) {
+  HandleType* hnd = (HandleType*)renderer;
+  Program* program = &hnd->programs[hnd->currentProgram];
+  if (program->paletteMode != (int)paletteMode) {
+    glUniform1i(program->paletteModeLocation, paletteMode);
+    program->paletteMode = paletteMode;
+  }
+}
+
+void NR_Renderer_SetGrid(NR_Renderer renderer, float x, float y, float cellWidth, float cellHeight) {
+  HandleType* hnd = (HandleType*)renderer;
+  Program* program = &hnd->programs[hnd->currentProgram];
+  GLfloat grid[4] = { x, y, cellWidth, cellHeight };
+  if (memcmp(program->grid, grid, sizeof(grid)) != 0) {
+    glUniform4fv(program->gridLocation, 1, grid);
+    memcpy(program->grid, grid, sizeof(grid));
+  }
+}
+
+GLuint NR_Renderer_GetEmptyVertexArray(NR_Renderer renderer) {
+  HandleType* hnd = (HandleType*)renderer;
+  return hnd->emptyVao;
+}
+
+void NR_Renderer_Invalidate(NR_Renderer renderer) {
+  HandleType* hnd = (HandleType*)renderer;
+
+  // Everything gets set again the next time it's needed.
+  hnd->blendSet = false;
+  hnd->currentProgram = -1;
+  hnd->currentVao = UNKNOWN;
+  for (int i = 0; i < NR_RENDERER_UNIT_COUNT; ++i) {
+    hnd->currentTextures[i] = UNKNOWN;
+  }
+  hnd->activeUnit = UNKNOWN;
+  hnd->currentUniformBuffers[0] = UNKNOWN;
+  hnd->currentUniformBuffers[1] = UNKNOWN;
+}
@@ -51,6 +51,16 @@ decode(uint32_t* state, uint32_t* codep, uint32_t byte) {
   return *state;
 }
 
+// How many fonts are kept loaded, so switching back to one doesn't load it again.
+#define FONT_CACHE_SIZE 4
+
+// A loaded font, with everything it's rendered so far.
+typedef struct {
+  char* name;
+  NR_Font font;
+  unsigned int lastUsed;
+} CachedFont;
+
 typedef struct {
   // Pointer to the base server
   NR_Server_Base baseServer;
@@ -65,11 +75,19 @@ typedef struct {
   double lastTime;
   int numFrames;
 
+  // Renderer state for our context, shared by every font we load.
+  NR_Renderer renderer;
+
   // Font.
   NR_Font font;
   char* fontName;
   int fontWidth, fontHeight;
 
+  // The fonts used most recently, including the current one. Fonts are all drawn at the same resolution, so
+  // they're only known by name.
+  CachedFont fontCache[FONT_CACHE_SIZE];
+  unsigned int fontUses;
+
   // The caption on the window.
   char* caption;
 
@@ -86,6 +104,18 @@ typedef struct {
   // This takes into account stuff like flashing characters.
   NR_Glyph* drawBuff;
 
+  // Styles registered by the client, indexed by id. Id 0 is NR_STYLE_NONE.
+  NR_Style styles[NR_MAX_STYLES];
+  unsigned int styleCount;
+
+  // How colours are interpreted, and the palette for palette mode.
+  NR_ColorMode colorMode;
+  unsigned int palette[NR_PALETTE_SIZE];
+
+  // Codepoints every font we load should render up front.
+  NR_Codepoint_Range* prewarmRanges;
+  unsigned int prewarmCount;
+
   // Width and height of our buffers.
   int buffWidth, buffHeight;
   bool buffSizeDirty;
@@ -124,6 +154,28 @@ static bool ConvPixelToGird(InternalData* internal, int* outX, int* outY, int in
   return true;
 }
 
+// Fill in the standard xterm 256 colour palette.
+static void _defaultPalette(unsigned int* palette) {
+  // The 16 basic colours.
+  static const unsigned int basic[16] = {
+    0x000000FF, 0xCD0000FF, 0x00CD00FF, 0xCDCD00FF, 0x0000EEFF, 0xCD00CDFF, 0x00CDCDFF, 0xE5E5E5FF,
+    0x7F7F7FFF, 0xFF0000FF, 0x00FF00FF, 0xFFFF00FF, 0x5C5CFFFF, 0xFF00FFFF, 0x00FFFFFF, 0xFFFFFFFF
+  };
+  for (int i = 0; i < 16; ++i)
+    palette[i] = basic[i];
+
+  // 6x6x6 colour cube.
+  static const unsigned int levels[6] = { 0x00, 0x5F, 0x87, 0xAF, 0xD7, 0xFF };
+  for (int i = 0; i < 216; ++i)
+    palette[16 + i] = (levels[i / 36] << 24) | (levels[(i / 6) % 6] << 16) | (levels[i % 6] << 8) | 0xFF;
+
+  // Greys.
+  for (int i = 0; i < 24; ++i) {
+    unsigned int level = 8 + i * 10;
+    palette[232 + i] = (level << 24) | (level << 16) | (level << 8) | 0xFF;
+  }
+}
+
 // Update buffer sizes..
 static void _updateBufferSizes(InternalData* internal, int width, int height) {
   // Having to resize the drawbuffers, so lock the drawing mutex.
@@ -181,7 +233,19 @@ static void _updateDrawBuffer(InternalData* internal) {
 
   // Copy each character across.
   for (int i = 0; i < buffSize; ++i) {
-    internal->drawBuff[i] = (*internal->frontBuff)[i];
+    NR_Glyph glyph = (*internal->frontBuff)[i];
+
+    // Look up the colours now, so that changing a style changes everything drawn with it.
+    if (glyph.style != NR_STYLE_NONE && glyph.style < internal->styleCount) {
+      const NR_Style* style = &internal->styles[glyph.style];
+      glyph.color = style->color;
+      glyph.bgColor = style->bgColor;
+      glyph.flashing = style->flashing;
+      glyph.bold = style->bold;
+      glyph.italic = style->italic;
+    }
+
+    internal->drawBuff[i] = glyph;
   }
 }
 
@@ -429,6 +493,9 @@ static bool _initialize(NR_Server_Base server) {
 
   internal->window = window;
 
+  // Create the renderer for this context.
+  internal->renderer = NR_Renderer_New();
+
   // Set this handle to be associated with our window, so that we can update stuff
   // properly in callbacks.
   glfwSetWindowUserPointer(window, (void*)internal);
@@ -458,6 +525,21 @@ static bool _initialize(NR_Server_Base server) {
   internal->buffWidth = 0;
   internal->buffHeight = 0;
 
+  // No styles yet, but id 0 is taken by NR_STYLE_NONE.
+  internal->styleCount = 1;
+
+  // Plain RGBA colours until we're asked for a palette.
+  internal->colorMode = NR_COLOR_MODE_RGBA;
+  _defaultPalette(internal->palette);
+
+  // Text and the characters terminal style interfaces are drawn with, until we're told otherwise.
+  static const NR_Codepoint_Range defaultRanges[] = {
+    NR_RANGE_ASCII, NR_RANGE_LATIN_1, NR_RANGE_BOX_DRAWING, NR_RANGE_BLOCK_ELEMENTS
+  };
+  internal->prewarmCount = sizeof(defaultRanges) / sizeof(NR_Codepoint_Range);
+  internal->prewarmRanges = malloc(sizeof(defaultRanges));
+  memcpy(internal->prewarmRanges, defaultRanges, sizeof(defaultRanges));
+
   // Create a mutex to synchronise the frontbuffer between the drawing thread and update thread.
   if (mtx_init(&internal->drawMutex, mtx_plain) != thrd_success)
     return false;
@@ -557,20 +639,51 @@ static bool _setFont(NR_Server_Base server, const char* font) {
   // Make sure our opengl context is current.
   glfwMakeContextCurrent(internal->window);
 
-  // Delete the current font if we have one.
-  if (internal->font)
-    NR_Font_Delete(internal->font);
-  internal->font = NR_Font_Load(font);
+  // The draw thread uses the font, so lock the mutex whilst we change or delete it.
+  mtx_lock(&internal->drawMutex);
+
+  // Use the font if it's still loaded, with its atlas intact. Otherwise load it in place of the one used least recently.
+  CachedFont* cached = (void*)0;
+  CachedFont* oldest = &internal->fontCache[0];
+  for (unsigned int i = 0; i < FONT_CACHE_SIZE && !cached; ++i) {
+    CachedFont* entry = &internal->fontCache[i];
+    if (entry->font && strcmp(entry->name, font) == 0)
+      cached = entry;
+    else if (!entry->font || (oldest->font && entry->lastUsed < oldest->lastUsed))
+      oldest = entry;
+  }
+
+  if (!cached) {
+    NR_Font loaded = NR_Font_Load(internal->renderer, font);
+    if (!loaded) {
+      mtx_unlock(&internal->drawMutex);
+      return false;
+    }
+
+    cached = oldest;
+    if (cached->font) {
+      NR_Font_Delete(cached->font);
+      free(cached->name);
+    }
+    cached->font = loaded;
+    cached->name = malloc(strlen(font) + 1);
+    strcpy(cached->name, font);
+  }
+  cached->lastUsed = ++internal->fontUses;
+  internal->font = cached->font;
+
+  // Carry the palette over to the new font, and start rendering the glyphs we'll probably need.
+  NR_Font_SetColorMode(internal->font, internal->colorMode);
+  NR_Font_SetPalette(internal->font, 0, NR_PALETTE_SIZE, internal->palette);
+  NR_Font_Prewarm(internal->font, internal->prewarmRanges, internal->prewarmCount);
 
   // Store the name.
-  if (internal->fontName)
-    internal->fontName = realloc(internal->fontName, strlen(font));
-  else
-    internal->fontName = malloc(strlen(font));
-  memcpy(internal->fontName, font, strlen(font));
+  internal->fontName = realloc(internal->fontName, strlen(font) + 1);
+  strcpy(internal->fontName, font);
 
   // Make sure the size is right.
   _setFontSize(server, internal->fontWidth, internal->fontHeight);
+  mtx_unlock(&internal->drawMutex);
 
   return internal->font;
 }
@@ -588,6 +701,11 @@ static bool _getFont(NR_Server_Base server, char* fontName, unsigned int size) {
   return false;
 }
 
+// A style id to store, dropping any that haven't been registered.
+static unsigned short _registeredStyle(InternalData* internal, unsigned short id) {
+  return id < internal->styleCount ? id : NR_STYLE_NONE;
+}
+
 static bool _setGlyph(NR_Server_Base server, unsigned int x, unsigned int y, const NR_Glyph* glyph) {
   InternalData* internal = (InternalData*)NR_Server_Base_GetUserData(server);
 
@@ -596,7 +714,15 @@ static bool _setGlyph(NR_Server_Base server, unsigned int x, unsigned int y, con
   if (y >= internal->buffHeight)
     return false;
 
-  (*internal->backBuff)[x + y * internal->buffWidth] = *glyph;
+  NR_Glyph* cell = &(*internal->backBuff)[x + y * internal->buffWidth];
+  *cell = *glyph;
+
+  // Display lists can be replayed in a different style.
+  unsigned short styleOverride = NR_Server_Base_GetStyleOverride(server);
+  if (styleOverride != NR_STYLE_NONE)
+    cell->style = styleOverride;
+  cell->style = _registeredStyle(internal, cell->style);
+
   return true;
 }
 
@@ -612,29 +738,222 @@ static bool _getGlyph(NR_Server_Base server, unsigned int x, unsigned int y, NR_
   return true;
 }
 
-static bool _text(NR_Server_Base server, unsigned int x, unsigned int y, const char* text, unsigned int color, unsigned int bgColor, bool flash) {
-  // Decode the text from utf-8.
-  uint32_t codepoint;
-  uint32_t state = 0;
-  uint32_t count = 0;
-
-  int stringSize = strlen(text);
-  for (int i = 0; i < stringSize; ++i, ++count)
-    if (!decode(&state, &codepoint, text[i])) {
-      NR_Glyph glyph;
+// Decode the codepoint starting at text[*pos], moving *pos past it.
+static bool _nextCodepoint(const char* text, unsigned int length, unsigned int* pos, uint32_t* codepoint) {
+  uint32_t state = UTF8_ACCEPT;
+  while (*pos < length) {
+    switch (decode(&state, codepoint, (uint8_t)text[(*pos)++])) {
+      case UTF8_ACCEPT: return true;
+      case UTF8_REJECT: return false;
+    }
+  }
+
+  // Ran out of bytes half way through a character.
+  return false;
+}
+
+// Where the next line of a text box ends.
+typedef struct {
+  unsigned int end;   // Byte offset just past the last character drawn on this line.
+  unsigned int next;  // Byte offset the following line starts at.
+  unsigned int cells; // How many cells the line takes up.
+  bool truncated;     // Whether characters were dropped off the end of the line.
+} LineBreak;
+
+// Measure out a single line of text starting at pos.
+static bool _breakLine(const char* text, unsigned int length, unsigned int pos, unsigned int w, NR_Wrap wrap, LineBreak* line) {
+  line->end = pos;
+  line->next = pos;
+  line->cells = 0;
+  line->truncated = false;
+
+  // The last place we could break between words.
+  bool haveSpace = false;
+  LineBreak atSpace;
+
+  while (line->next < length) {
+    unsigned int charStart = line->next;
+    uint32_t codepoint;
+    if (!_nextCodepoint(text, length, &line->next, &codepoint))
+      return false;
+
+    // Explicit line break.
+    if (codepoint == '\n')
+      return true;
+
+    // Line is full.
+    if (line->cells == w) {
+      if (wrap == NR_WRAP_NONE) {
+        // Skip everything up to the next explicit line break.
+        line->truncated = true;
+        while (line->next < length) {
+          if (!_nextCodepoint(text, length, &line->next, &codepoint))
+            return false;
+          if (codepoint == '\n')
+            break;
+        }
+        return true;
+      }
+
+      // Spaces at the edge of the box can just be swallowed.
+      if (codepoint == ' ')
+        return true;
+
+      // Go back to the last space, so the word ends up on the next line.
+      if (wrap == NR_WRAP_WORD && haveSpace) {
+        *line = atSpace;
+        return true;
+      }
+
+      // Otherwise break right here.
+      line->next = charStart;
+      return true;
+    }
+
+    // Remember where the line would end if we broke at this space.
+    if (codepoint == ' ' && line->cells > 0) {
+      haveSpace = true;
+      atSpace.end = line->end;
+      atSpace.cells = line->cells;
+      atSpace.next = line->next;
+      atSpace.truncated = false;
+    }
+
+    line->end = line->next;
+    line->cells++;
+  }
+
+  return true;
+}
+
+// How to style the characters in some text.
+typedef struct {
+  NR_Glyph base;             // Anything not covered by a span.
+  const NR_Text_Span* spans; // Sorted by offset.
+  unsigned int spanCount;
+} TextStyle;
+
+// Lay text out in a box, starting at the top left. Stops once the box is full.
+static bool _layoutText(NR_Server_Base server, unsigned int x, unsigned int y, unsigned int w, unsigned int h, const char* text,
+                        const TextStyle* style, NR_Wrap wrap, NR_Align align, NR_Overflow overflow, unsigned int* bytesConsumed) {
+  unsigned int length = strlen(text);
+  unsigned int pos = 0;
+
+  // The span we're currently in. Spans are sorted so we only ever need to move forward.
+  unsigned int span = 0;
+  NR_Glyph glyph = style->base;
+
+  for (unsigned int row = 0; row < h && pos < length; ++row) {
+    LineBreak line;
+    if (!_breakLine(text, length, pos, w, wrap, &line))
+      return false;
+
+    // Whether there's more text than we're going to show.
+    bool lastRow = row + 1 == h;
+    bool clipped = line.truncated || (lastRow && line.next < length);
+
+    // Line up the line in the box.
+    unsigned int offset = 0;
+    if (align == NR_ALIGN_CENTER) offset = (w - line.cells) / 2;
+    else if (align == NR_ALIGN_RIGHT) offset = w - line.cells;
+
+    // Draw each character in the line.
+    unsigned int col = offset;
+    unsigned int charStart = pos;
+    while (pos < line.end) {
+      // Find the style for this character.
+      while (span < style->spanCount && style->spans[span].offset + style->spans[span].length <= pos)
+        span++;
+
+      glyph = style->base;
+      if (span < style->spanCount && style->spans[span].offset <= pos) {
+        glyph.color = style->spans[span].color;
+        glyph.bgColor = style->spans[span].bgColor;
+        glyph.flashing = style->spans[span].flash;
+        glyph.style = style->spans[span].style;
+      }
+
+      uint32_t codepoint;
+      charStart = pos;
+      _nextCodepoint(text, length, &pos, &codepoint);
       glyph.codepoint = codepoint;
-      glyph.color = color;
-      glyph.bgColor = bgColor;
-      glyph.flashing = flash;
+      _setGlyph(server, x + col, y + row, &glyph);
+      col++;
+    }
 
-      _setGlyph(server, x + count, y, &glyph);
+    // Mark that there was more to this line.
+    if (clipped && overflow == NR_OVERFLOW_ELLIPSIS && w > 0) {
+      glyph.codepoint = 0x2026; // '…'
+      if (col < w) {
+        _setGlyph(server, x + col, y + row, &glyph);
+      } else {
+        _setGlyph(server, x + w - 1, y + row, &glyph);
+
+        // The ellipsis covered up the last character, so it wasn't really shown.
+        if (lastRow) {
+          *bytesConsumed = charStart;
+          return true;
+        }
+      }
     }
 
-  if (state != UTF8_ACCEPT)
-    return false;
+    pos = line.next;
+  }
+
+  *bytesConsumed = pos;
   return true;
 }
 
+static void _initTextStyle(TextStyle* style, unsigned int color, unsigned int bgColor, bool flash) {
+  memset(style, 0, sizeof(TextStyle));
+  style->base.color = color;
+  style->base.bgColor = bgColor;
+  style->base.flashing = flash;
+}
+
+// Draw a single line of text running off to the edge of the screen.
+static bool _textLine(NR_Server_Base server, unsigned int x, unsigned int y, const char* text, const TextStyle* style) {
+  InternalData* internal = (InternalData*)NR_Server_Base_GetUserData(server);
+
+  unsigned int width = x < internal->buffWidth ? internal->buffWidth - x : 0;
+  unsigned int bytesConsumed;
+  return _layoutText(server, x, y, width, 1, text, style, NR_WRAP_NONE, NR_ALIGN_LEFT, NR_OVERFLOW_CLIP, &bytesConsumed);
+}
+
+static bool _richText(NR_Server_Base server, unsigned int x, unsigned int y, const char* text, unsigned int color, unsigned int bgColor, bool flash,
+                      const NR_Text_Span* spans, unsigned int spanCount) {
+  TextStyle style;
+  _initTextStyle(&style, color, bgColor, flash);
+  style.spans = spans;
+  style.spanCount = spanCount;
+
+  return _textLine(server, x, y, text, &style);
+}
+
+static bool _text(NR_Server_Base server, unsigned int x, unsigned int y, const char* text, unsigned int color, unsigned int bgColor, bool flash) {
+  TextStyle style;
+  _initTextStyle(&style, color, bgColor, flash);
+
+  return _textLine(server, x, y, text, &style);
+}
+
+static bool _styledText(NR_Server_Base server, unsigned int x, unsigned int y, const char* text, unsigned short styleId) {
+  TextStyle style;
+  _initTextStyle(&style, 0, 0, false);
+  style.base.style = styleId;
+
+  return _textLine(server, x, y, text, &style);
+}
+
+static bool _textBox(NR_Server_Base server, unsigned int x, unsigned int y, unsigned int w, unsigned int h, const char* text,
+                     unsigned int color, unsigned int bgColor, bool flash,
+                     NR_Wrap wrap, NR_Align align, NR_Overflow overflow, unsigned int* bytesConsumed) {
+  TextStyle style;
+  _initTextStyle(&style, color, bgColor, flash);
+
+  return _layoutText(server, x, y, w, h, text, &style, wrap, align, overflow, bytesConsumed);
+}
+
 static bool _rectangle(NR_Server_Base server, unsigned int x, unsigned int y, unsigned int w, unsigned int h, bool fill, const NR_Glyph* glyph) {
   if (fill) {
     // Filled rectangle.
@@ -658,6 +977,80 @@ static bool _rectangle(NR_Server_Base server, unsigned int x, unsigned int y, un
   return true;
 }
 
+static bool _registerStyle(NR_Server_Base server, const NR_Style* style, unsigned short* id) {
+  InternalData* internal = (InternalData*)NR_Server_Base_GetUserData(server);
+
+  // Out of room for styles.
+  if (internal->styleCount >= NR_MAX_STYLES)
+    return false;
+
+  // The draw thread reads styles, so lock the mutex.
+  mtx_lock(&internal->drawMutex);
+  *id = internal->styleCount++;
+  internal->styles[*id] = *style;
+  mtx_unlock(&internal->drawMutex);
+
+  return true;
+}
+
+static bool _setStyle(NR_Server_Base server, unsigned short id, const NR_Style* style) {
+  InternalData* internal = (InternalData*)NR_Server_Base_GetUserData(server);
+
+  if (id == NR_STYLE_NONE || id >= internal->styleCount)
+    return false;
+
+  mtx_lock(&internal->drawMutex);
+  internal->styles[id] = *style;
+  mtx_unlock(&internal->drawMutex);
+
+  return true;
+}
+
+static bool _setColorMode(NR_Server_Base server, NR_ColorMode mode) {
+  InternalData* internal = (InternalData*)NR_Server_Base_GetUserData(server);
+
+  mtx_lock(&internal->drawMutex);
+  internal->colorMode = mode;
+  if (internal->font)
+    NR_Font_SetColorMode(internal->font, mode);
+  mtx_unlock(&internal->drawMutex);
+
+  return true;
+}
+
+static bool _setPalette(NR_Server_Base server, unsigned int start, unsigned int count, const unsigned int* colors) {
+  InternalData* internal = (InternalData*)NR_Server_Base_GetUserData(server);
+
+  if (start >= NR_PALETTE_SIZE || count > NR_PALETTE_SIZE - start)
+    return false;
+
+  // The font uploads the palette on the draw thread, we just have to hand it over.
+  mtx_lock(&internal->drawMutex);
+  memcpy(internal->palette + start, colors, sizeof(unsigned int) * count);
+  if (internal->font)
+    NR_Font_SetPalette(internal->font, start, count, colors);
+  mtx_unlock(&internal->drawMutex);
+
+  return true;
+}
+
+static bool _prewarmGlyphs(NR_Server_Base server, const NR_Codepoint_Range* ranges, unsigned int count) {
+  InternalData* internal = (InternalData*)NR_Server_Base_GetUserData(server);
+
+  // Keep them for fonts we load later.
+  mtx_lock(&internal->drawMutex);
+  internal->prewarmRanges = realloc(internal->prewarmRanges, sizeof(NR_Codepoint_Range) * count);
+  memcpy(internal->prewarmRanges, ranges, sizeof(NR_Codepoint_Range) * count);
+  internal->prewarmCount = count;
+
+  // The font renders them in the background.
+  if (internal->font)
+    NR_Font_Prewarm(internal->font, ranges, count);
+  mtx_unlock(&internal->drawMutex);
+
+  return true;
+}
+
 static bool _swapBuffers(NR_Server_Base server) {
   InternalData* internal = (InternalData*)NR_Server_Base_GetUserData(server);
 
@@ -676,9 +1069,15 @@ static bool _swapBuffers(NR_Server_Base server) {
 static bool _clear(NR_Server_Base server, const NR_Glyph* glyph) {
   InternalData* internal = (InternalData*)NR_Server_Base_GetUserData(server);
 
+  NR_Glyph clearGlyph = *glyph;
+  unsigned short styleOverride = NR_Server_Base_GetStyleOverride(server);
+  if (styleOverride != NR_STYLE_NONE)
+    clearGlyph.style = styleOverride;
+  clearGlyph.style = _registeredStyle(internal, clearGlyph.style);
+
   unsigned int buffSize = internal->buffWidth * internal->buffHeight;
   for (unsigned int i = 0; i < buffSize; ++i) {
-    (*internal->backBuff)[i] = *glyph;
+    (*internal->backBuff)[i] = clearGlyph;
   }
 
   return true;
@@ -720,8 +1119,19 @@ NR_Server_Base NR_GLFW_Server_New(NR_Context* context, const char* replyAddress,
   callbacks.getGlyph = _getGlyph;
 
   callbacks.text = _text;
+  callbacks.textBox = _textBox;
+  callbacks.richText = _richText;
+  callbacks.styledText = _styledText;
   callbacks.rectangle = _rectangle;
 
+  callbacks.registerStyle = _registerStyle;
+  callbacks.setStyle = _setStyle;
+
+  callbacks.setColorMode = _setColorMode;
+  callbacks.setPalette = _setPalette;
+
+  callbacks.prewarmGlyphs = _prewarmGlyphs;
+
   callbacks.clear = _clear;
   callbacks.swapBuffers = _swapBuffers;
 
@@ -747,15 +1157,24 @@ void NR_GLFW_Server_Delete(NR_Server_Base server) {
   thrd_detach(internal->drawThread);
   mtx_destroy(&internal->drawMutex);
 
-  // Delete the font we potentially have allocated.
-  if (internal->font)
-    NR_Font_Delete(internal->font);
+  // Delete the fonts we potentially have loaded.
+  for (unsigned int i = 0; i < FONT_CACHE_SIZE; ++i) {
+    if (internal->fontCache[i].font) {
+      NR_Font_Delete(internal->fontCache[i].font);
+      free(internal->fontCache[i].name);
+    }
+  }
+
+  // And the renderer it drew with.
+  if (internal->renderer)
+    NR_Renderer_Delete(internal->renderer);
 
   // Delete the font name
   if (internal->fontName)
     free(internal->fontName);
   if (internal->caption)
     free(internal->caption);
+  free(internal->prewarmRanges);
 
   // De-allocate front and back buffers.
   free(internal->buff1);
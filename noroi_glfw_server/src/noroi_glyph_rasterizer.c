@@ -0,0 +1,442 @@
+#include <noroi/glfw_server/noroi_glyph_rasterizer.h>
+
+#include <noroi/glfw_server/noroi_coverage.h>
+#include <noroi/base/tinycthread.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+// Freetype.
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include FT_MODULE_H
+#include FT_SYNTHESIS_H
+
+// The distance field renderers arrived in freetype 2.11.
+#if FREETYPE_MAJOR * 100 + FREETYPE_MINOR >= 211
+#define DISTANCE_FIELD_MODE FT_RENDER_MODE_SDF
+#endif
+
+// What's happened to a requested codepoint.
+typedef enum {
+  REQUEST_EMPTY,   // Free slot.
+  REQUEST_PENDING, // Queued or being rendered.
+  REQUEST_DONE,    // Rendered and handed over.
+  REQUEST_FAILED,  // Freetype couldn't render it.
+  REQUEST_EVICTED  // Handed over, but thrown away since. Asking again renders it again.
+} RequestState;
+
+typedef struct {
+  NR_GlyphRasterizer_Key key;
+  RequestState state;
+} Request;
+
+// A face in the fallback chain, and which codepoints it has.
+typedef struct {
+  FT_Face face;
+  NR_Coverage coverage;
+  int width, height;
+} Face;
+
+// Internal representation of NR_GlyphRasterizer
+typedef struct {
+  // Our own freetype library and faces, in fallback order, only touched by the worker once it's started.
+  // Their coverage never changes, so it can be read from anywhere.
+  FT_Library library;
+  Face* faces;
+  unsigned int faceCount;
+
+  // Every glyph requested, in an open addressed table.
+  Request* requests;
+  unsigned int requestCount, requestCapacity;
+
+  // Glyphs waiting to be rendered, in a ring.
+  NR_GlyphRasterizer_Key* queue;
+  unsigned int queueStart, queueCount, queueCapacity;
+
+  // Rendered glyphs waiting to be received, in the order they were requested.
+  NR_GlyphRasterizer_Glyph* results;
+  unsigned int resultStart, resultCount, resultCapacity;
+
+  // Whether the worker is in the middle of rendering something.
+  bool busy;
+  bool quit;
+
+  thrd_t thread;
+  mtx_t mutex;
+  cnd_t workAvailable;
+  cnd_t idle;
+} HandleType;
+
+// Copepoint hash function ( found at https://github.com/akrinke/Font-Stash/blob/master/fontstash.c )
+static unsigned int _hashCodePoint(unsigned int a) {
+  a += ~(a<<15);
+  a ^=  (a>>10);
+  a +=  (a<<3);
+  a ^=  (a>>6);
+  a += ~(a<<11);
+  a ^=  (a>>16);
+  return a;
+}
+
+static bool _keyEqual(const NR_GlyphRasterizer_Key* a, const NR_GlyphRasterizer_Key* b) {
+  return a->codepoint == b->codepoint && a->width == b->width && a->height == b->height && a->style == b->style &&
+         a->distanceField == b->distanceField;
+}
+
+// Find the slot for a glyph, either holding it or empty.
+static Request* _findRequest(Request* requests, unsigned int capacity, const NR_GlyphRasterizer_Key* key) {
+  unsigned int hash = _hashCodePoint(key->codepoint ^ (key->style << 21) ^ ((unsigned int)key->distanceField << 31) ^
+                                     ((unsigned int)key->width << 23) ^ ((unsigned int)key->height << 11));
+  unsigned int i = hash & (capacity - 1);
+  while (requests[i].state != REQUEST_EMPTY && !_keyEqual(&requests[i].key, key))
+    i = (i + 1) & (capacity - 1);
+
+  return &requests[i];
+}
+
+// Add a glyph to the requests, growing the table to keep it at most half full.
+static Request* _addRequest(HandleType* hnd, const NR_GlyphRasterizer_Key* key) {
+  if ((hnd->requestCount + 1) * 2 > hnd->requestCapacity) {
+    unsigned int capacity = hnd->requestCapacity ? hnd->requestCapacity * 2 : 256;
+    Request* requests = calloc(capacity, sizeof(Request));
+    for (unsigned int i = 0; i < hnd->requestCapacity; ++i) {
+      if (hnd->requests[i].state != REQUEST_EMPTY)
+        *_findRequest(requests, capacity, &hnd->requests[i].key) = hnd->requests[i];
+    }
+
+    free(hnd->requests);
+    hnd->requests = requests;
+    hnd->requestCapacity = capacity;
+  }
+
+  Request* request = _findRequest(hnd->requests, hnd->requestCapacity, key);
+  request->key = *key;
+  hnd->requestCount++;
+  return request;
+}
+
+static void _push(HandleType* hnd, const NR_GlyphRasterizer_Key* key) {
+  if (hnd->queueCount == hnd->queueCapacity) {
+    // Grow, unwrapping the ring as we go.
+    unsigned int capacity = hnd->queueCapacity ? hnd->queueCapacity * 2 : 256;
+    NR_GlyphRasterizer_Key* queue = malloc(sizeof(NR_GlyphRasterizer_Key) * capacity);
+    for (unsigned int i = 0; i < hnd->queueCount; ++i)
+      queue[i] = hnd->queue[(hnd->queueStart + i) % hnd->queueCapacity];
+
+    free(hnd->queue);
+    hnd->queue = queue;
+    hnd->queueStart = 0;
+    hnd->queueCapacity = capacity;
+  }
+
+  hnd->queue[(hnd->queueStart + hnd->queueCount) % hnd->queueCapacity] = *key;
+  hnd->queueCount++;
+}
+
+static NR_GlyphRasterizer_Key _pop(HandleType* hnd) {
+  NR_GlyphRasterizer_Key key = hnd->queue[hnd->queueStart];
+  hnd->queueStart = (hnd->queueStart + 1) % hnd->queueCapacity;
+  hnd->queueCount--;
+  return key;
+}
+
+// The first face with a glyph for a codepoint, or the first face if none have one, for its missing glyph.
+static Face* _faceFor(HandleType* hnd, unsigned int codepoint) {
+  for (unsigned int i = 0; i < hnd->faceCount; ++i) {
+    if (NR_Coverage_Has(hnd->faces[i].coverage, codepoint))
+      return &hnd->faces[i];
+  }
+
+  return &hnd->faces[0];
+}
+
+// Render a glyph with the worker's faces.
+static void _render(HandleType* hnd, const NR_GlyphRasterizer_Key* key, NR_GlyphRasterizer_Glyph* glyph) {
+  memset(glyph, 0, sizeof(NR_GlyphRasterizer_Glyph));
+  glyph->key = *key;
+
+  Face* face = _faceFor(hnd, key->codepoint);
+  if (key->width != face->width || key->height != face->height) {
+    FT_Set_Pixel_Sizes(face->face, key->width, key->height);
+    face->width = key->width;
+    face->height = key->height;
+  }
+
+  // Styles are made from the outline before it's rendered, and distance fields are rendered from the outline.
+  bool fromOutline = key->style || key->distanceField;
+  unsigned long c = FT_Get_Char_Index(face->face, key->codepoint);
+  if (FT_Load_Glyph(face->face, c, fromOutline ? FT_LOAD_DEFAULT : FT_LOAD_RENDER) != 0)
+    return;
+
+  FT_GlyphSlot slot = face->face->glyph;
+  if (fromOutline) {
+    if (key->style & NR_GLYPH_STYLE_ITALIC)
+      FT_GlyphSlot_Oblique(slot);
+    if (key->style & NR_GLYPH_STYLE_BOLD)
+      FT_GlyphSlot_Embolden(slot);
+
+    // Emboldened outlines overlap themselves, which the outline distance field renderer gets wrong, so
+    // those are rendered to coverage first and the distance field is made from that.
+    bool viaBitmap = key->distanceField && (key->style & NR_GLYPH_STYLE_BOLD);
+    if (viaBitmap && FT_Render_Glyph(slot, FT_RENDER_MODE_NORMAL) != 0)
+      return;
+#ifdef DISTANCE_FIELD_MODE
+    if (FT_Render_Glyph(slot, key->distanceField ? DISTANCE_FIELD_MODE : FT_RENDER_MODE_NORMAL) != 0)
+      return;
+#else
+    if (FT_Render_Glyph(slot, FT_RENDER_MODE_NORMAL) != 0)
+      return;
+#endif
+  }
+
+  glyph->rendered = true;
+  glyph->width = slot->bitmap.width;
+  glyph->height = slot->bitmap.rows;
+  glyph->advance = slot->advance.x >> 6;
+  glyph->bearingX = slot->bitmap_left;
+  glyph->bearingY = slot->bitmap_top;
+
+  // Copy the bitmap out row by row, the pitch may be padded.
+  glyph->bitmap = malloc(glyph->width * glyph->height + 1);
+  for (unsigned int y = 0; y < glyph->height; ++y)
+    memcpy(glyph->bitmap + y * glyph->width, slot->bitmap.buffer + y * slot->bitmap.pitch, glyph->width);
+}
+
+bool NR_GlyphRasterizer_HasDistanceFields() {
+#ifdef DISTANCE_FIELD_MODE
+  return true;
+#else
+  return false;
+#endif
+}
+
+static int _work(void* data) {
+  HandleType* hnd = (HandleType*)data;
+
+  mtx_lock(&hnd->mutex);
+  while (true) {
+    while (hnd->queueCount == 0 && !hnd->quit)
+      cnd_wait(&hnd->workAvailable, &hnd->mutex);
+
+    if (hnd->quit)
+      break;
+
+    // Take the next glyph, and render it without holding the lock.
+    NR_GlyphRasterizer_Key key = _pop(hnd);
+    hnd->busy = true;
+    mtx_unlock(&hnd->mutex);
+
+    NR_GlyphRasterizer_Glyph glyph;
+    _render(hnd, &key, &glyph);
+
+    mtx_lock(&hnd->mutex);
+    hnd->busy = false;
+
+    Request* request = _findRequest(hnd->requests, hnd->requestCapacity, &key);
+    request->state = glyph.rendered ? REQUEST_DONE : REQUEST_FAILED;
+
+    // Hand it over even if it failed, so whoever asked can stop waiting for it.
+    if (hnd->resultCount == hnd->resultCapacity) {
+      hnd->resultCapacity = hnd->resultCapacity ? hnd->resultCapacity * 2 : 64;
+      hnd->results = realloc(hnd->results, sizeof(NR_GlyphRasterizer_Glyph) * hnd->resultCapacity);
+    }
+    hnd->results[hnd->resultCount++] = glyph;
+
+    if (hnd->queueCount == 0)
+      cnd_broadcast(&hnd->idle);
+  }
+  mtx_unlock(&hnd->mutex);
+
+  return 0;
+}
+
+// Close every face, and the library they were opened with.
+static void _closeFaces(HandleType* hnd) {
+  for (unsigned int i = 0; i < hnd->faceCount; ++i) {
+    FT_Done_Face(hnd->faces[i].face);
+    NR_Coverage_Delete(hnd->faces[i].coverage);
+  }
+  free(hnd->faces);
+  FT_Done_FreeType(hnd->library);
+}
+
+NR_GlyphRasterizer NR_GlyphRasterizer_New(const NR_GlyphRasterizer_Source* sources, unsigned int count) {
+  HandleType* hnd = malloc(sizeof(HandleType));
+  memset(hnd, 0, sizeof(HandleType));
+
+  // Freetype libraries can't be shared between threads, so make our own.
+  if (FT_Init_FreeType(&hnd->library) != 0) {
+    free(hnd);
+    return (void*)0;
+  }
+
+  hnd->faces = malloc(sizeof(Face) * count);
+  for (unsigned int i = 0; i < count; ++i) {
+    Face* face = &hnd->faces[i];
+    FT_Error err = sources[i].data ? FT_New_Memory_Face(hnd->library, sources[i].data, sources[i].size, 0, &face->face)
+                                   : FT_New_Face(hnd->library, sources[i].path, 0, &face->face);
+    if (err != 0) {
+      _closeFaces(hnd);
+      free(hnd);
+      return (void*)0;
+    }
+    FT_Select_Charmap(face->face, FT_ENCODING_UNICODE);
+    face->width = face->height = 0;
+
+    // Note every codepoint it has once, so finding the face for one never has to ask freetype.
+    face->coverage = NR_Coverage_New();
+    FT_UInt index;
+    for (FT_ULong codepoint = FT_Get_First_Char(face->face, &index); index != 0; codepoint = FT_Get_Next_Char(face->face, codepoint, &index))
+      NR_Coverage_Add(face->coverage, (unsigned int)codepoint);
+
+    hnd->faceCount++;
+  }
+
+  // Distance fields reach as far as the shaders expect, whether they're made from outlines or bitmaps.
+  FT_Int spread = NR_GLYPH_DISTANCE_SPREAD;
+  FT_Property_Set(hnd->library, "sdf", "spread", &spread);
+  FT_Property_Set(hnd->library, "bsdf", "spread", &spread);
+
+  mtx_init(&hnd->mutex, mtx_plain);
+  cnd_init(&hnd->workAvailable);
+  cnd_init(&hnd->idle);
+
+  if (thrd_create(&hnd->thread, _work, (void*)hnd) != thrd_success) {
+    cnd_destroy(&hnd->idle);
+    cnd_destroy(&hnd->workAvailable);
+    mtx_destroy(&hnd->mutex);
+    _closeFaces(hnd);
+    free(hnd);
+    return (void*)0;
+  }
+
+  return (void*)hnd;
+}
+
+void NR_GlyphRasterizer_Delete(NR_GlyphRasterizer rasterizer) {
+  HandleType* hnd = (HandleType*)rasterizer;
+
+  // Stop the worker.
+  mtx_lock(&hnd->mutex);
+  hnd->quit = true;
+  cnd_broadcast(&hnd->workAvailable);
+  mtx_unlock(&hnd->mutex);
+  thrd_join(hnd->thread, (int*)0);
+
+  cnd_destroy(&hnd->idle);
+  cnd_destroy(&hnd->workAvailable);
+  mtx_destroy(&hnd->mutex);
+
+  for (unsigned int i = hnd->resultStart; i < hnd->resultCount; ++i)
+    NR_GlyphRasterizer_FreeGlyph(&hnd->results[i]);
+  free(hnd->results);
+  free(hnd->queue);
+  free(hnd->requests);
+
+  _closeFaces(hnd);
+
+  free(hnd);
+}
+
+bool NR_GlyphRasterizer_HasGlyph(NR_GlyphRasterizer rasterizer, unsigned int codepoint) {
+  HandleType* hnd = (HandleType*)rasterizer;
+  for (unsigned int i = 0; i < hnd->faceCount; ++i) {
+    if (NR_Coverage_Has(hnd->faces[i].coverage, codepoint))
+      return true;
+  }
+
+  return false;
+}
+
+void NR_GlyphRasterizer_CancelOtherSizes(NR_GlyphRasterizer rasterizer, int width, int height, bool distanceField) {
+  HandleType* hnd = (HandleType*)rasterizer;
+
+  // Take everything at other sizes out of the queue. They're rendered if they're asked for again.
+  mtx_lock(&hnd->mutex);
+  unsigned int kept = 0;
+  for (unsigned int i = 0; i < hnd->queueCount; ++i) {
+    NR_GlyphRasterizer_Key key = hnd->queue[(hnd->queueStart + i) % hnd->queueCapacity];
+    if (key.width == width && key.height == height && key.distanceField == distanceField) {
+      hnd->queue[(hnd->queueStart + kept++) % hnd->queueCapacity] = key;
+    } else {
+      _findRequest(hnd->requests, hnd->requestCapacity, &key)->state = REQUEST_EVICTED;
+    }
+  }
+  hnd->queueCount = kept;
+
+  if (hnd->queueCount == 0 && !hnd->busy)
+    cnd_broadcast(&hnd->idle);
+  mtx_unlock(&hnd->mutex);
+}
+
+bool NR_GlyphRasterizer_Request(NR_GlyphRasterizer rasterizer, const NR_GlyphRasterizer_Key* key) {
+  HandleType* hnd = (HandleType*)rasterizer;
+
+  mtx_lock(&hnd->mutex);
+  Request* request = hnd->requests ? _findRequest(hnd->requests, hnd->requestCapacity, key) : (void*)0;
+  if (!request || request->state == REQUEST_EMPTY)
+    request = _addRequest(hnd, key);
+  if (request->state == REQUEST_EMPTY || request->state == REQUEST_EVICTED) {
+    request->state = REQUEST_PENDING;
+    _push(hnd, key);
+    cnd_signal(&hnd->workAvailable);
+  }
+  bool failed = request->state == REQUEST_FAILED;
+  mtx_unlock(&hnd->mutex);
+
+  return !failed;
+}
+
+void NR_GlyphRasterizer_Forget(NR_GlyphRasterizer rasterizer, const NR_GlyphRasterizer_Key* key) {
+  HandleType* hnd = (HandleType*)rasterizer;
+
+  // Keep the slot, so the table doesn't need tombstones.
+  mtx_lock(&hnd->mutex);
+  Request* request = hnd->requests ? _findRequest(hnd->requests, hnd->requestCapacity, key) : (void*)0;
+  if (request && request->state == REQUEST_DONE)
+    request->state = REQUEST_EVICTED;
+  mtx_unlock(&hnd->mutex);
+}
+
+void NR_GlyphRasterizer_MarkFailed(NR_GlyphRasterizer rasterizer, const NR_GlyphRasterizer_Key* key) {
+  HandleType* hnd = (HandleType*)rasterizer;
+
+  mtx_lock(&hnd->mutex);
+  Request* request = hnd->requests ? _findRequest(hnd->requests, hnd->requestCapacity, key) : (void*)0;
+  if (request && request->state == REQUEST_DONE)
+    request->state = REQUEST_FAILED;
+  mtx_unlock(&hnd->mutex);
+}
+
+bool NR_GlyphRasterizer_Receive(NR_GlyphRasterizer rasterizer, NR_GlyphRasterizer_Glyph* glyph) {
+  HandleType* hnd = (HandleType*)rasterizer;
+
+  mtx_lock(&hnd->mutex);
+  bool received = hnd->resultStart < hnd->resultCount;
+  if (received)
+    *glyph = hnd->results[hnd->resultStart++];
+
+  // Start from the beginning again once they've all been taken.
+  if (hnd->resultStart == hnd->resultCount) {
+    hnd->resultStart = 0;
+    hnd->resultCount = 0;
+  }
+  mtx_unlock(&hnd->mutex);
+
+  return received;
+}
+
+void NR_GlyphRasterizer_FreeGlyph(NR_GlyphRasterizer_Glyph* glyph) {
+  free(glyph->bitmap);
+  glyph->bitmap = (void*)0;
+}
+
+void NR_GlyphRasterizer_Wait(NR_GlyphRasterizer rasterizer) {
+  HandleType* hnd = (HandleType*)rasterizer;
+
+  mtx_lock(&hnd->mutex);
+  while (hnd->queueCount > 0 || hnd->busy)
+    cnd_wait(&hnd->idle, &hnd->mutex);
+  mtx_unlock(&hnd->mutex);
+}
@@ -1,9 +1,16 @@
 #include <noroi/glfw_server/noroi_glyphpacker.h>
 
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 
-#define GLYPH_BUCKET_SIZE (256)
+// Codepoints below this are looked up directly, most cells are in this range. Each of the
+// first DIRECT_VARIANTS variants gets its own direct array.
+#define DIRECT_CODEPOINTS 0x800
+#define DIRECT_VARIANTS 64
+
+// An empty slot in the index.
+#define NO_SLOT UINT_MAX
 
 // Copepoint hash function ( found at https://github.com/akrinke/Font-Stash/blob/master/fontstash.c )
 static unsigned int _hashCodePoint(unsigned int a) {
@@ -16,11 +23,12 @@ static unsigned int _hashCodePoint(unsigned int a) {
 	return a;
 }
 
-// Linked list.
-typedef struct GlyphInfoLinked_s {
-  NR_GlyphPacker_Glyph info;
-  struct GlyphInfoLinked_s* next;
-} GlyphInfo;
+// Where a codepoint's glyph is in the glyph array, for the open addressed table.
+typedef struct {
+  unsigned int codepoint;
+  unsigned int variant;
+  unsigned int slot;
+} IndexEntry;
 
 // Uses the algorithm described here
 // http://www.blackpawn.com/texts/lightmaps/default.html
@@ -95,17 +103,219 @@ bool RectTreeNode_Insert(RectTreeNode* parent, unsigned int codepoint, unsigned
 	}
 }
 
-// Handle type.
+// Skyline packing, as described in
+// http://clb.demon.fi/files/RectangleBinPack.pdf
+// Glyphs are stacked bottom-left on the outline of what's been packed so far. Terminal glyphs
+// are all about the same height, so little space is lost under it.
+
+// A run of the skyline, the top of everything packed between x and x + width is at y.
+typedef struct {
+	unsigned int x, y, width;
+} SkylineNode;
+
+// A page's skyline from left to right, in one array that's reused when the page is cleared.
 typedef struct {
-  GlyphInfo* bucket[GLYPH_BUCKET_SIZE];
+	SkylineNode* nodes;
+	unsigned int count, capacity;
+} Skyline;
+
+static void Skyline_Reset(Skyline* skyline, unsigned int width) {
+	if (skyline->capacity == 0) {
+		skyline->capacity = 64;
+		skyline->nodes = malloc(sizeof(SkylineNode) * skyline->capacity);
+	}
+
+	skyline->nodes[0].x = 0;
+	skyline->nodes[0].y = 0;
+	skyline->nodes[0].width = width;
+	skyline->count = 1;
+}
+
+// Where a rect would sit if placed at the start of node i, if it fits on the page.
+static bool Skyline_Fit(const Skyline* skyline, unsigned int i, unsigned int width, unsigned int height,
+                        unsigned int pageWidth, unsigned int pageHeight, unsigned int* y) {
+	if (skyline->nodes[i].x + width > pageWidth)
+		return false;
+
+	// Rest it on the highest node it spans.
+	unsigned int top = 0;
+	unsigned int remaining = width;
+	while (true) {
+		const SkylineNode* node = &skyline->nodes[i++];
+		if (node->y > top)
+			top = node->y;
+		if (top + height > pageHeight)
+			return false;
+		if (node->width >= remaining)
+			break;
+		remaining -= node->width;
+	}
+
+	*y = top;
+	return true;
+}
+
+static bool Skyline_Insert(Skyline* skyline, unsigned int width, unsigned int height, unsigned int pageWidth, unsigned int pageHeight,
+                           unsigned int* x, unsigned int* y) {
+	// Find the node where the rect's top would be lowest, then the narrowest.
+	unsigned int best = skyline->count;
+	unsigned int bestTop = 0, bestWidth = 0, bestY = 0;
+	for (unsigned int i = 0; i < skyline->count; ++i) {
+		unsigned int top;
+		if (!Skyline_Fit(skyline, i, width, height, pageWidth, pageHeight, &top))
+			continue;
+
+		if (best == skyline->count || top + height < bestTop || (top + height == bestTop && skyline->nodes[i].width < bestWidth)) {
+			best = i;
+			bestTop = top + height;
+			bestWidth = skyline->nodes[i].width;
+			bestY = top;
+		}
+	}
+
+	if (best == skyline->count)
+		return false;
+
+	// Make room for a new node.
+	if (skyline->count == skyline->capacity) {
+		skyline->capacity *= 2;
+		skyline->nodes = realloc(skyline->nodes, sizeof(SkylineNode) * skyline->capacity);
+	}
+	memmove(&skyline->nodes[best + 1], &skyline->nodes[best], sizeof(SkylineNode) * (skyline->count - best));
+	skyline->count++;
+
+	SkylineNode* node = &skyline->nodes[best];
+	node->y = bestTop;
+	node->width = width;
+	*x = node->x;
+	*y = bestY;
+
+	// Cut the nodes it now covers out of the skyline.
+	unsigned int right = node->x + width;
+	unsigned int i = best + 1;
+	while (i < skyline->count && skyline->nodes[i].x < right) {
+		SkylineNode* covered = &skyline->nodes[i];
+		unsigned int shrink = right - covered->x;
+		if (covered->width > shrink) {
+			covered->x += shrink;
+			covered->width -= shrink;
+			break;
+		}
 
+		memmove(covered, covered + 1, sizeof(SkylineNode) * (skyline->count - i - 1));
+		skyline->count--;
+	}
+
+	// Join neighbours at the same height.
+	for (i = 0; i + 1 < skyline->count; ) {
+		if (skyline->nodes[i].y == skyline->nodes[i + 1].y) {
+			skyline->nodes[i].width += skyline->nodes[i + 1].width;
+			memmove(&skyline->nodes[i + 1], &skyline->nodes[i + 2], sizeof(SkylineNode) * (skyline->count - i - 2));
+			skyline->count--;
+		} else {
+			++i;
+		}
+	}
+
+	return true;
+}
+
+// Handle type.
+typedef struct {
+  // Every glyph, in one array. They're found by codepoint through their variant's direct array below
+  // DIRECT_CODEPOINTS, and through an open addressed table kept at most half full above.
+  NR_GlyphPacker_Glyph* glyphs;
+  unsigned int glyphCount, glyphCapacity;
+  unsigned int* direct[DIRECT_VARIANTS]; // Allocated the first time the variant is used.
+  IndexEntry* table;
+  unsigned int tableCount, tableCapacity;
+
+	// Each page, as a tree or a skyline depending on the method.
+	NR_GlyphPacker_Method method;
 	RectTreeNode** pages;
+	Skyline* skylines;
 	unsigned int maxPage;
 
   unsigned int width, height;
 } HandleType;
 
+// Find a glyph's entry in the table, either holding it or empty.
+static IndexEntry* _findEntry(IndexEntry* table, unsigned int capacity, unsigned int codepoint, unsigned int variant) {
+  unsigned int i = _hashCodePoint(codepoint ^ (variant << 21)) & (capacity - 1);
+  while (table[i].slot != NO_SLOT && (table[i].codepoint != codepoint || table[i].variant != variant))
+    i = (i + 1) & (capacity - 1);
+
+  return &table[i];
+}
+
+// Index the glyph in a slot by its codepoint and variant, growing the table to keep it at most half full.
+static void _index(HandleType* hnd, unsigned int slot) {
+  unsigned int codepoint = hnd->glyphs[slot].codepoint;
+  unsigned int variant = hnd->glyphs[slot].variant;
+  if (codepoint < DIRECT_CODEPOINTS && variant < DIRECT_VARIANTS) {
+    if (!hnd->direct[variant]) {
+      hnd->direct[variant] = malloc(sizeof(unsigned int) * DIRECT_CODEPOINTS);
+      memset(hnd->direct[variant], 0xFF, sizeof(unsigned int) * DIRECT_CODEPOINTS);
+    }
+
+    hnd->direct[variant][codepoint] = slot;
+    return;
+  }
+
+  if ((hnd->tableCount + 1) * 2 > hnd->tableCapacity) {
+    unsigned int capacity = hnd->tableCapacity ? hnd->tableCapacity * 2 : 256;
+    IndexEntry* table = malloc(sizeof(IndexEntry) * capacity);
+    memset(table, 0xFF, sizeof(IndexEntry) * capacity);
+    for (unsigned int i = 0; i < hnd->tableCapacity; ++i) {
+      if (hnd->table[i].slot != NO_SLOT)
+        *_findEntry(table, capacity, hnd->table[i].codepoint, hnd->table[i].variant) = hnd->table[i];
+    }
+
+    free(hnd->table);
+    hnd->table = table;
+    hnd->tableCapacity = capacity;
+  }
+
+  IndexEntry* entry = _findEntry(hnd->table, hnd->tableCapacity, codepoint, variant);
+  entry->codepoint = codepoint;
+  entry->variant = variant;
+  entry->slot = slot;
+  hnd->tableCount++;
+}
+
+// The slot holding a glyph, or NO_SLOT.
+static unsigned int _lookup(HandleType* hnd, unsigned int codepoint, unsigned int variant) {
+  if (codepoint < DIRECT_CODEPOINTS && variant < DIRECT_VARIANTS)
+    return hnd->direct[variant] ? hnd->direct[variant][codepoint] : NO_SLOT;
+  if (hnd->tableCount == 0)
+    return NO_SLOT;
+
+  return _findEntry(hnd->table, hnd->tableCapacity, codepoint, variant)->slot;
+}
+
+// Start a page again, empty.
+static void _resetPage(HandleType* hnd, unsigned int page) {
+	if (hnd->method == NR_GLYPHPACKER_METHOD_TREE) {
+		RectTreeNode_Delete(hnd->pages[page]);
+		hnd->pages[page] = RectTreeNode_New(0, 0, hnd->width, hnd->height);
+	} else {
+		Skyline_Reset(&hnd->skylines[page], hnd->width);
+	}
+}
+
+// Insert a rect onto a page.
+static bool _insert(HandleType* hnd, unsigned int page, unsigned int codepoint, unsigned int width, unsigned int height, unsigned int* x, unsigned int* y) {
+	if (hnd->method == NR_GLYPHPACKER_METHOD_TREE)
+		return RectTreeNode_Insert(hnd->pages[page], codepoint, width, height, x, y);
+
+	return Skyline_Insert(&hnd->skylines[page], width, height, hnd->width, hnd->height, x, y);
+}
+
 NR_GlyphPacker* NR_GlyphPacker_New(int width, int height, int maxPage) {
+	return NR_GlyphPacker_NewWithMethod(width, height, maxPage, NR_GLYPHPACKER_METHOD_SKYLINE);
+}
+
+NR_GlyphPacker* NR_GlyphPacker_NewWithMethod(int width, int height, int maxPage, NR_GlyphPacker_Method method) {
 	// Allocate a handle.
 	HandleType* hnd = malloc(sizeof(HandleType));
   if (!hnd)
@@ -115,15 +325,11 @@ NR_GlyphPacker* NR_GlyphPacker_New(int width, int height, int maxPage) {
 	// Set page width, and the maximum page count.
   hnd->width = width;
   hnd->height = height;
-  hnd->maxPage = maxPage;
-
-	// Allocate trees for each page.
-	hnd->pages = malloc(sizeof(RectTreeNode*) * maxPage);
-	if (!hnd->pages)
-		return (void*)0;
-	for (int i = 0; i < maxPage; ++i) {
-		hnd->pages[i] = RectTreeNode_New(0, 0, width, height);
-	}
+  hnd->maxPage = 0;
+  hnd->method = method;
+
+	// Allocate empty pages.
+	NR_GlyphPacker_SetPageCount((void*)hnd, maxPage);
 
   return (void*)hnd;
 }
@@ -131,32 +337,32 @@ NR_GlyphPacker* NR_GlyphPacker_New(int width, int height, int maxPage) {
 void NR_GlyphPacker_Delete(NR_GlyphPacker* packer) {
   HandleType* hnd = (HandleType*)packer;
 
-  // Free the linked lists in the bucket.
-  for (int i = 0; i < GLYPH_BUCKET_SIZE; ++i) {
-    GlyphInfo* info = hnd->bucket[i];
-    while (info) {
-      GlyphInfo* next = info->next;
-      free(info);
-      info = next;
-    }
+  // Free the glyphs and their index.
+  free(hnd->glyphs);
+  free(hnd->table);
+  for (int i = 0; i < DIRECT_VARIANTS; ++i) {
+    free(hnd->direct[i]);
   }
 
 	// Free pages.
-	for (int i = 0; i < hnd->maxPage; ++i) {
-		RectTreeNode_Delete(hnd->pages[i]);
+	for (unsigned int i = 0; i < hnd->maxPage; ++i) {
+		if (hnd->pages)
+			RectTreeNode_Delete(hnd->pages[i]);
+		if (hnd->skylines)
+			free(hnd->skylines[i].nodes);
 	}
 	free(hnd->pages);
+	free(hnd->skylines);
 
   // Free the handle data.
   free(packer);
 }
 
-bool NR_GlyphPacker_Add(NR_GlyphPacker* packer, const NR_GlyphPacker_Glyph* glyph) {
-  HandleType* hnd = (HandleType*)packer;
-
+// Add a glyph to the first of pages first to last it fits on.
+static bool _add(HandleType* hnd, const NR_GlyphPacker_Glyph* glyph, unsigned int first, unsigned int last) {
   // Make sure we don't already have this glyph.
   NR_GlyphPacker_Glyph found;
-  if (!NR_GlyphPacker_Find(packer, glyph->codepoint, &found)) {
+  if (!NR_GlyphPacker_Find((void*)hnd, glyph->codepoint, glyph->variant, &found)) {
     // Not found, so let's add it.
     // Figure out where to place it...
 
@@ -164,9 +370,9 @@ bool NR_GlyphPacker_Add(NR_GlyphPacker* packer, const NR_GlyphPacker_Glyph* glyp
 		unsigned int x, y;
 		unsigned int page = 0;
 		bool inserted = false;
-		for (int i = 0; i < hnd->maxPage; ++i) {
+		for (unsigned int i = first; i <= last && i < hnd->maxPage; ++i) {
 			// +1 to width and height so that there is a 1 pixel border between glyphs.
-			if (RectTreeNode_Insert(hnd->pages[i], glyph->codepoint, glyph->width+1, glyph->height+1, &x, &y)) {
+			if (_insert(hnd, i, glyph->codepoint, glyph->width+1, glyph->height+1, &x, &y)) {
 				inserted = true;
 				page = i;
 				break;
@@ -176,41 +382,97 @@ bool NR_GlyphPacker_Add(NR_GlyphPacker* packer, const NR_GlyphPacker_Glyph* glyp
 		// If we couldn't find any pages to insert into.. we're full!
 		if (!inserted) return false;
 
-    // Add to the hash map.
-    unsigned int hash = _hashCodePoint(glyph->codepoint) % GLYPH_BUCKET_SIZE;
-
-    GlyphInfo* info = malloc(sizeof(GlyphInfo));
-    memset(info, 0, sizeof(GlyphInfo));
-		info->info = *glyph;
-		info->info.x = x;
-		info->info.y = y;
-		info->info.page = page;
-    info->next = hnd->bucket[hash];
-    hnd->bucket[hash] = info;
+    // Add to the glyphs, and index it.
+    if (hnd->glyphCount == hnd->glyphCapacity) {
+      hnd->glyphCapacity = hnd->glyphCapacity ? hnd->glyphCapacity * 2 : 256;
+      hnd->glyphs = realloc(hnd->glyphs, sizeof(NR_GlyphPacker_Glyph) * hnd->glyphCapacity);
+    }
+
+    NR_GlyphPacker_Glyph* info = &hnd->glyphs[hnd->glyphCount];
+		*info = *glyph;
+		info->x = x;
+		info->y = y;
+		info->page = page;
+    info->uv[0] = (float)x / (float)hnd->width;
+    info->uv[1] = (float)y / (float)hnd->height;
+    info->uv[2] = info->uv[0] + (float)glyph->width / (float)hnd->width;
+    info->uv[3] = info->uv[1] + (float)glyph->height / (float)hnd->height;
+    _index(hnd, hnd->glyphCount++);
   }
 
   return true;
 }
 
-bool NR_GlyphPacker_Find(NR_GlyphPacker* packer, unsigned int codepoint, NR_GlyphPacker_Glyph* glyph) {
+bool NR_GlyphPacker_Add(NR_GlyphPacker* packer, const NR_GlyphPacker_Glyph* glyph) {
+  HandleType* hnd = (HandleType*)packer;
+  return hnd->maxPage > 0 && _add(hnd, glyph, 0, hnd->maxPage - 1);
+}
+
+bool NR_GlyphPacker_AddToPage(NR_GlyphPacker* packer, const NR_GlyphPacker_Glyph* glyph, unsigned int page) {
   HandleType* hnd = (HandleType*)packer;
+  return _add(hnd, glyph, page, page);
+}
 
-  // Get the hash for this codepoint, and the link in the bucket.
-  unsigned int hash = _hashCodePoint(codepoint) % GLYPH_BUCKET_SIZE;
-  GlyphInfo* link = hnd->bucket[hash];
+unsigned int NR_GlyphPacker_GetPageCount(NR_GlyphPacker* packer) {
+  HandleType* hnd = (HandleType*)packer;
+  return hnd->maxPage;
+}
 
-  // Search through the linked list for this particular codepoint.
-  while (true) {
-    // Got to the end without finding anything.
-    if (!link) return false;
+void NR_GlyphPacker_SetPageCount(NR_GlyphPacker* packer, unsigned int count) {
+  HandleType* hnd = (HandleType*)packer;
+  if (count <= hnd->maxPage)
+    return;
+
+  // New pages start out empty, the ones we have are left as they are.
+  if (hnd->method == NR_GLYPHPACKER_METHOD_TREE) {
+    hnd->pages = realloc(hnd->pages, sizeof(RectTreeNode*) * count);
+    memset(hnd->pages + hnd->maxPage, 0, sizeof(RectTreeNode*) * (count - hnd->maxPage));
+  } else {
+    hnd->skylines = realloc(hnd->skylines, sizeof(Skyline) * count);
+    memset(hnd->skylines + hnd->maxPage, 0, sizeof(Skyline) * (count - hnd->maxPage));
+  }
 
-    // Found it!
-    if (link->info.codepoint == codepoint) {
-      *glyph = link->info;
-      return true;
-    }
+  for (unsigned int i = hnd->maxPage; i < count; ++i) {
+    _resetPage(hnd, i);
+  }
+  hnd->maxPage = count;
+}
 
-    // Try the next item.
-    link = link->next;
+void NR_GlyphPacker_ClearPage(NR_GlyphPacker* packer, unsigned int page) {
+  HandleType* hnd = (HandleType*)packer;
+  if (page >= hnd->maxPage)
+    return;
+
+  // Take the page's glyphs out, and index the rest again.
+  unsigned int kept = 0;
+  for (unsigned int i = 0; i < hnd->glyphCount; ++i) {
+    if (hnd->glyphs[i].page != page)
+      hnd->glyphs[kept++] = hnd->glyphs[i];
+  }
+  hnd->glyphCount = kept;
+
+  for (int i = 0; i < DIRECT_VARIANTS; ++i) {
+    if (hnd->direct[i])
+      memset(hnd->direct[i], 0xFF, sizeof(unsigned int) * DIRECT_CODEPOINTS);
   }
+  if (hnd->table)
+    memset(hnd->table, 0xFF, sizeof(IndexEntry) * hnd->tableCapacity);
+  hnd->tableCount = 0;
+  for (unsigned int i = 0; i < hnd->glyphCount; ++i) {
+    _index(hnd, i);
+  }
+
+  // And start it again.
+  _resetPage(hnd, page);
+}
+
+bool NR_GlyphPacker_Find(NR_GlyphPacker* packer, unsigned int codepoint, unsigned int variant, NR_GlyphPacker_Glyph* glyph) {
+  HandleType* hnd = (HandleType*)packer;
+
+  unsigned int slot = _lookup(hnd, codepoint, variant);
+  if (slot == NO_SLOT)
+    return false;
+
+  *glyph = hnd->glyphs[slot];
+  return true;
 }
@@ -29,13 +29,13 @@ int main(int argc, char** argv) {
   NR_Client_SetFontSize(client, 0, 25);
 
   // A glyph to test with.
-  NR_Glyph hashGlyph;
+  NR_Glyph hashGlyph = NR_Glyph();
   hashGlyph.codepoint = '#';
   hashGlyph.flashing = true;
   hashGlyph.color = 0xCCCCCCFF;
   hashGlyph.color = 0xFFFFFFFF;
 
-  NR_Glyph zeroGlyph;
+  NR_Glyph zeroGlyph = NR_Glyph();
   zeroGlyph.codepoint = 'O';
   zeroGlyph.flashing = false;
   zeroGlyph.color = 0xFF0000FF;
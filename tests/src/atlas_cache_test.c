@@ -0,0 +1,151 @@
+#include <unity.h>
+#include <noroi/glfw_server/noroi_atlas_cache.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PAGE_WIDTH 256
+#define PAGE_HEIGHT 256
+#define PAGE_COUNT 2
+#define GLYPH_COUNT 100
+#define CACHE_PATH "atlas_cache_test.cache"
+
+static NR_AtlasCache_Key key;
+static NR_AtlasCache_Glyph glyphs[GLYPH_COUNT];
+static unsigned char* pages[PAGE_COUNT];
+
+// Pack some glyphs, and save them with some made up pages.
+static void _save() {
+  NR_GlyphPacker* packer = NR_GlyphPacker_New(PAGE_WIDTH, PAGE_HEIGHT, PAGE_COUNT);
+  for (int i = 0; i < GLYPH_COUNT; ++i) {
+    NR_GlyphPacker_Glyph glyph;
+    memset(&glyph, 0, sizeof(glyph));
+    glyph.codepoint = i;
+    glyph.width = 5 + rand() % 20;
+    glyph.height = 5 + rand() % 20;
+    glyph.bearingY = i;
+    NR_GlyphPacker_Add(packer, &glyph);
+    NR_GlyphPacker_Find(packer, i, 0, &glyphs[i].glyph);
+    glyphs[i].pixelWidth = 0;
+    glyphs[i].pixelHeight = 10 + i % 3;
+    glyphs[i].style = i % 4;
+    glyphs[i].distanceField = i % 5 == 0;
+  }
+  NR_GlyphPacker_Delete(packer);
+
+  for (int i = 0; i < PAGE_COUNT; ++i) {
+    for (int j = 0; j < PAGE_WIDTH * PAGE_HEIGHT; ++j) {
+      pages[i][j] = (unsigned char)rand();
+    }
+  }
+
+  TEST_ASSERT_MESSAGE(NR_AtlasCache_Save(CACHE_PATH, &key, glyphs, GLYPH_COUNT, pages, PAGE_COUNT), "Couldn't save the cache!");
+}
+
+void test_round_trip() {
+  _save();
+
+  NR_AtlasCache cache = NR_AtlasCache_Open(CACHE_PATH, &key);
+  TEST_ASSERT_MESSAGE(cache, "Couldn't open the cache we just saved!");
+  TEST_ASSERT_EQUAL(GLYPH_COUNT, NR_AtlasCache_GetGlyphCount(cache));
+  TEST_ASSERT_EQUAL(PAGE_COUNT, NR_AtlasCache_GetPageCount(cache));
+
+  for (int i = 0; i < GLYPH_COUNT; ++i) {
+    NR_AtlasCache_Glyph cached;
+    NR_AtlasCache_GetGlyph(cache, i, &cached);
+    TEST_ASSERT_EQUAL(glyphs[i].pixelWidth, cached.pixelWidth);
+    TEST_ASSERT_EQUAL(glyphs[i].pixelHeight, cached.pixelHeight);
+    TEST_ASSERT_EQUAL(glyphs[i].style, cached.style);
+    TEST_ASSERT_EQUAL(glyphs[i].distanceField, cached.distanceField);
+    TEST_ASSERT_EQUAL(glyphs[i].glyph.codepoint, cached.glyph.codepoint);
+    TEST_ASSERT_EQUAL(glyphs[i].glyph.x, cached.glyph.x);
+    TEST_ASSERT_EQUAL(glyphs[i].glyph.y, cached.glyph.y);
+    TEST_ASSERT_EQUAL(glyphs[i].glyph.page, cached.glyph.page);
+    TEST_ASSERT_EQUAL(glyphs[i].glyph.bearingY, cached.glyph.bearingY);
+    TEST_ASSERT_EQUAL_FLOAT(glyphs[i].glyph.uv[2], cached.glyph.uv[2]);
+  }
+
+  unsigned char* page = malloc(PAGE_WIDTH * PAGE_HEIGHT);
+  for (int i = 0; i < PAGE_COUNT; ++i) {
+    TEST_ASSERT_MESSAGE(NR_AtlasCache_CopyPage(cache, i, page), "Undamaged page failed its check!");
+    TEST_ASSERT_EQUAL_MEMORY_MESSAGE(pages[i], page, PAGE_WIDTH * PAGE_HEIGHT, "Page didn't come back the same!");
+  }
+  free(page);
+
+  NR_AtlasCache_Close(cache);
+}
+
+void test_stale_cache() {
+  _save();
+
+  // A different page size, or a different font.
+  NR_AtlasCache_Key other = key;
+  other.pageHeight *= 2;
+  TEST_ASSERT_MESSAGE(!NR_AtlasCache_Open(CACHE_PATH, &other), "Opened a cache made for another page size!");
+
+  other = key;
+  other.fontHash++;
+  TEST_ASSERT_MESSAGE(!NR_AtlasCache_Open(CACHE_PATH, &other), "Opened a cache made for another font!");
+}
+
+// Flip a byte of the cache file, offset from the start, or from the end if it's negative.
+static void _damage(long offset) {
+  FILE* file = fopen(CACHE_PATH, "r+b");
+  fseek(file, offset, offset < 0 ? SEEK_END : SEEK_SET);
+  int c = fgetc(file);
+  fseek(file, offset, offset < 0 ? SEEK_END : SEEK_SET);
+  fputc(c ^ 0xFF, file);
+  fclose(file);
+}
+
+void test_corrupt_cache() {
+  // Damage a glyph, the whole cache is thrown away.
+  _save();
+  _damage(100);
+  TEST_ASSERT_MESSAGE(!NR_AtlasCache_Open(CACHE_PATH, &key), "Opened a cache with a damaged glyph!");
+
+  // Damage the last page, it fails its check when it's copied out, but the first page is fine.
+  _save();
+  _damage(-100);
+  NR_AtlasCache cache = NR_AtlasCache_Open(CACHE_PATH, &key);
+  TEST_ASSERT_MESSAGE(cache, "Pages were checked when the cache was opened!");
+
+  unsigned char* page = malloc(PAGE_WIDTH * PAGE_HEIGHT);
+  TEST_ASSERT_MESSAGE(NR_AtlasCache_CopyPage(cache, 0, page), "Undamaged page failed its check!");
+  TEST_ASSERT_MESSAGE(!NR_AtlasCache_CopyPage(cache, PAGE_COUNT - 1, page), "Damaged page passed its check!");
+  free(page);
+  NR_AtlasCache_Close(cache);
+
+  // Cut it short.
+  _save();
+  FILE* file = fopen(CACHE_PATH, "wb");
+  fputs("NRAC", file);
+  fclose(file);
+
+  TEST_ASSERT_MESSAGE(!NR_AtlasCache_Open(CACHE_PATH, &key), "Opened a truncated cache!");
+}
+
+int main(int argc, char** argv) {
+  const char font[] = "not really a font";
+  key.fontHash = NR_AtlasCache_Hash(font, sizeof(font));
+  key.pageWidth = PAGE_WIDTH;
+  key.pageHeight = PAGE_HEIGHT;
+
+  for (int i = 0; i < PAGE_COUNT; ++i) {
+    pages[i] = malloc(PAGE_WIDTH * PAGE_HEIGHT);
+  }
+
+  UNITY_BEGIN();
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_stale_cache);
+  RUN_TEST(test_corrupt_cache);
+  int result = UNITY_END();
+
+  for (int i = 0; i < PAGE_COUNT; ++i) {
+    free(pages[i]);
+  }
+  remove(CACHE_PATH);
+
+  return result;
+}
@@ -0,0 +1,100 @@
+#include <unity.h>
+#include <noroi/glfw_server/noroi_coverage.h>
+#include <noroi/glfw_server/noroi_glyph_rasterizer.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+void test_add_has() {
+  NR_Coverage coverage = NR_Coverage_New();
+
+  // Codepoints in a few blocks, at the edges of them.
+  const unsigned int codepoints[] = { 0, 'A', 0xFF, 0x100, 0x4E00, 0x1F600, 0x10FFFF };
+  const int count = sizeof(codepoints) / sizeof(codepoints[0]);
+  for (int i = 0; i < count; ++i) {
+    NR_Coverage_Add(coverage, codepoints[i]);
+  }
+
+  for (int i = 0; i < count; ++i) {
+    TEST_ASSERT_MESSAGE(NR_Coverage_Has(coverage, codepoints[i]), "Codepoint went missing!");
+  }
+
+  // Neighbours in the same blocks, blocks with nothing in them, and past the end of unicode.
+  TEST_ASSERT_MESSAGE(!NR_Coverage_Has(coverage, 'B'), "Found a codepoint that was never added!");
+  TEST_ASSERT_MESSAGE(!NR_Coverage_Has(coverage, 0x4E01), "Found a codepoint that was never added!");
+  TEST_ASSERT_MESSAGE(!NR_Coverage_Has(coverage, 0x3000), "Found a codepoint in an empty block!");
+  TEST_ASSERT_MESSAGE(!NR_Coverage_Has(coverage, 0x110000), "Found a codepoint past the end of unicode!");
+
+  NR_Coverage_Delete(coverage);
+}
+
+// Render one glyph with a new rasterizer.
+static void _renderGlyph(const NR_GlyphRasterizer_Source* sources, unsigned int count, unsigned int codepoint, NR_GlyphRasterizer_Glyph* glyph) {
+  NR_GlyphRasterizer rasterizer = NR_GlyphRasterizer_New(sources, count);
+  TEST_ASSERT_MESSAGE(rasterizer, "Couldn't open the fonts!");
+
+  NR_GlyphRasterizer_Key key = { codepoint, 0, 20, NR_GLYPH_STYLE_REGULAR, false };
+  NR_GlyphRasterizer_Request(rasterizer, &key);
+  NR_GlyphRasterizer_Wait(rasterizer);
+
+  TEST_ASSERT_MESSAGE(NR_GlyphRasterizer_Receive(rasterizer, glyph), "Nothing was rendered!");
+  TEST_ASSERT_MESSAGE(glyph->rendered, "The glyph wasn't rendered!");
+  NR_GlyphRasterizer_Delete(rasterizer);
+}
+
+static bool _sameGlyph(const NR_GlyphRasterizer_Glyph* a, const NR_GlyphRasterizer_Glyph* b) {
+  return a->width == b->width && a->height == b->height && a->advance == b->advance &&
+         a->bearingX == b->bearingX && a->bearingY == b->bearingY &&
+         memcmp(a->bitmap, b->bitmap, a->width * a->height) == 0;
+}
+
+void test_fallback_coverage() {
+  // The test font has no snowman, the fallback does.
+  NR_GlyphRasterizer_Source font = { "data/font.ttf", (void*)0, 0 };
+  NR_GlyphRasterizer_Source fallback = { "data/DejaVuSansMono.ttf", (void*)0, 0 };
+  NR_GlyphRasterizer_Source chain[2] = { font, fallback };
+
+  NR_GlyphRasterizer alone = NR_GlyphRasterizer_New(&font, 1);
+  TEST_ASSERT_MESSAGE(alone, "Couldn't open the font!");
+  TEST_ASSERT_MESSAGE(NR_GlyphRasterizer_HasGlyph(alone, 'A'), "The font has no A!");
+  TEST_ASSERT_MESSAGE(!NR_GlyphRasterizer_HasGlyph(alone, 0x2603), "The font has a snowman it shouldn't!");
+  NR_GlyphRasterizer_Delete(alone);
+
+  NR_GlyphRasterizer both = NR_GlyphRasterizer_New(chain, 2);
+  TEST_ASSERT_MESSAGE(both, "Couldn't open the fonts!");
+  TEST_ASSERT_MESSAGE(NR_GlyphRasterizer_HasGlyph(both, 0x2603), "The fallback's snowman wasn't found!");
+  TEST_ASSERT_MESSAGE(!NR_GlyphRasterizer_HasGlyph(both, 0x10FFFF), "Found a glyph neither font has!");
+  NR_GlyphRasterizer_Delete(both);
+
+  // The snowman comes from the fallback, rather than being the first font's missing glyph.
+  NR_GlyphRasterizer_Glyph fromChain, fromFallback, missing;
+  _renderGlyph(chain, 2, 0x2603, &fromChain);
+  _renderGlyph(&fallback, 1, 0x2603, &fromFallback);
+  _renderGlyph(&font, 1, 0x2603, &missing);
+  TEST_ASSERT_MESSAGE(_sameGlyph(&fromChain, &fromFallback), "The snowman wasn't rendered from the fallback!");
+  TEST_ASSERT_MESSAGE(!_sameGlyph(&fromChain, &missing), "The snowman was the missing glyph!");
+  NR_GlyphRasterizer_FreeGlyph(&fromChain);
+  NR_GlyphRasterizer_FreeGlyph(&fromFallback);
+  NR_GlyphRasterizer_FreeGlyph(&missing);
+
+  // Glyphs the first font has still come from it.
+  _renderGlyph(chain, 2, 'A', &fromChain);
+  _renderGlyph(&font, 1, 'A', &fromFallback);
+  TEST_ASSERT_MESSAGE(_sameGlyph(&fromChain, &fromFallback), "The A didn't come from the first font!");
+  NR_GlyphRasterizer_FreeGlyph(&fromChain);
+  NR_GlyphRasterizer_FreeGlyph(&fromFallback);
+
+  // Codepoints none of the fonts have still get the missing glyph.
+  _renderGlyph(chain, 2, 0x10FFFF, &fromChain);
+  _renderGlyph(&font, 1, 0x10FFFF, &missing);
+  TEST_ASSERT_MESSAGE(_sameGlyph(&fromChain, &missing), "A codepoint neither font has wasn't the missing glyph!");
+  NR_GlyphRasterizer_FreeGlyph(&fromChain);
+  NR_GlyphRasterizer_FreeGlyph(&missing);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_add_has);
+  RUN_TEST(test_fallback_coverage);
+  return UNITY_END();
+}
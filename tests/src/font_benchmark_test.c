@@ -0,0 +1,390 @@
+#include <unity.h>
+#include <noroi/glfw_server/noroi_glfw_font.h>
+#include <noroi/glfw_server/noroi_glyph_rasterizer.h>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define WIDTH 800
+#define HEIGHT 600
+#define FRAMES 200
+
+static GLFWwindow* window;
+static NR_Renderer renderer;
+static NR_Font font;
+static NR_Glyph* grid;
+static int gridWidth, gridHeight;
+
+// Fill the grid, changing every cell if churn is set, otherwise only the first row.
+static void _fillGrid(int frame, bool churn) {
+  for (int i = 0; i < gridWidth * gridHeight; ++i) {
+    bool change = churn || i < gridWidth;
+    grid[i].codepoint = 'A' + ((i + (change ? frame : 0)) % 26);
+    grid[i].color = 0xFFFFFFFF;
+    grid[i].bgColor = (i % 2) ? 0x0000FFFF : 0x000000FF;
+  }
+}
+
+// Draw a number of frames, returning the average time in ms and how many cells were uploaded.
+static double _drawFrames(bool churn, unsigned int* cellsUploaded) {
+  *cellsUploaded = 0;
+
+  double start = glfwGetTime();
+  for (int frame = 0; frame < FRAMES; ++frame) {
+    _fillGrid(frame, churn);
+    glClear(GL_COLOR_BUFFER_BIT);
+    NR_Font_Draw(font, grid, gridWidth, gridHeight, 0, 0, WIDTH, HEIGHT);
+
+    NR_Font_Stats stats;
+    NR_Font_GetStats(font, &stats);
+    *cellsUploaded += stats.cellsUploaded;
+  }
+  glFinish();
+
+  return (glfwGetTime() - start) * 1000.0 / FRAMES;
+}
+
+void test_static_vs_churn() {
+  // Draw once so that every glyph is already in the atlas.
+  _fillGrid(0, true);
+  NR_Font_Draw(font, grid, gridWidth, gridHeight, 0, 0, WIDTH, HEIGHT);
+  NR_Font_WaitForGlyphs(font);
+  NR_Font_Draw(font, grid, gridWidth, gridHeight, 0, 0, WIDTH, HEIGHT);
+
+  unsigned int staticUploaded, churnUploaded;
+  double staticTime = _drawFrames(false, &staticUploaded);
+  double churnTime = _drawFrames(true, &churnUploaded);
+
+  printf("%ix%i grid: mostly static %.3f ms/frame (%u cells uploaded), full churn %.3f ms/frame (%u cells uploaded)\n",
+         gridWidth, gridHeight, staticTime, staticUploaded, churnTime, churnUploaded);
+
+  TEST_ASSERT_MESSAGE(staticUploaded < churnUploaded, "Unchanged cells are being uploaded again!");
+}
+
+void test_unchanged_frame_uploads_nothing() {
+  _fillGrid(0, true);
+  for (int i = 0; i < 4; ++i) {
+    NR_Font_Draw(font, grid, gridWidth, gridHeight, 0, 0, WIDTH, HEIGHT);
+  }
+
+  NR_Font_Stats stats;
+  NR_Font_GetStats(font, &stats);
+  TEST_ASSERT_EQUAL_MESSAGE(0, stats.cellsRebuilt, "Unchanged cells were rebuilt!");
+  TEST_ASSERT_EQUAL_MESSAGE(0, stats.cellsUploaded, "Unchanged cells were uploaded!");
+}
+
+void test_scattered_changes_upload_together() {
+  _fillGrid(0, true);
+  for (int i = 0; i < 4; ++i) {
+    NR_Font_Draw(font, grid, gridWidth, gridHeight, 0, 0, WIDTH, HEIGHT);
+  }
+  glFinish();
+
+  // Cells a few apart are uploaded in one go, along with the ones between them.
+  unsigned int cellCount = gridWidth * gridHeight;
+  grid[0].codepoint++;
+  grid[4].codepoint++;
+  grid[8].codepoint++;
+
+  // Cells far apart are uploaded on their own.
+  grid[cellCount - 1].codepoint++;
+  NR_Font_Draw(font, grid, gridWidth, gridHeight, 0, 0, WIDTH, HEIGHT);
+
+  NR_Font_Stats stats;
+  NR_Font_GetStats(font, &stats);
+  TEST_ASSERT_EQUAL_MESSAGE(2, stats.cellUploads, "Nearby changes weren't uploaded together!");
+  TEST_ASSERT_EQUAL_MESSAGE(10, stats.cellsUploaded, "Far apart changes were uploaded together!");
+
+  // A change to every few cells across the grid is uploaded all at once.
+  glFinish();
+  for (unsigned int i = 0; i < cellCount; i += 4) {
+    grid[i].codepoint++;
+  }
+  NR_Font_Draw(font, grid, gridWidth, gridHeight, 0, 0, WIDTH, HEIGHT);
+
+  NR_Font_GetStats(font, &stats);
+  TEST_ASSERT_EQUAL_MESSAGE(1, stats.cellUploads, "Scattered changes weren't uploaded at once!");
+  TEST_ASSERT_EQUAL_MESSAGE(cellCount, stats.cellsUploaded, "Scattered changes weren't uploaded at once!");
+}
+
+void test_new_glyphs_dont_wait() {
+  // Glyphs that haven't been drawn yet.
+  for (int i = 0; i < gridWidth * gridHeight; ++i) {
+    grid[i].codepoint = 'a' + (i % 26);
+  }
+
+  // The first draw shouldn't wait for them to be rendered.
+  double start = glfwGetTime();
+  NR_Font_Draw(font, grid, gridWidth, gridHeight, 0, 0, WIDTH, HEIGHT);
+  double firstTime = (glfwGetTime() - start) * 1000.0;
+
+  NR_Font_Stats stats;
+  NR_Font_GetStats(font, &stats);
+  unsigned int waiting = stats.cellsWaiting;
+  TEST_ASSERT_MESSAGE(waiting > 0, "New glyphs were rendered while drawing!");
+
+  // Once they're rendered, only the cells that were waiting get rebuilt.
+  NR_Font_WaitForGlyphs(font);
+  NR_Font_Draw(font, grid, gridWidth, gridHeight, 0, 0, WIDTH, HEIGHT);
+  NR_Font_GetStats(font, &stats);
+
+  printf("%ix%i grid: first draw of new glyphs %.3f ms (%u cells waiting)\n", gridWidth, gridHeight, firstTime, waiting);
+
+  TEST_ASSERT_EQUAL_MESSAGE(0, stats.cellsWaiting, "Cells are still waiting for rendered glyphs!");
+  TEST_ASSERT_EQUAL_MESSAGE(waiting, stats.cellsRebuilt, "Cells that weren't waiting were rebuilt!");
+  TEST_ASSERT_EQUAL_MESSAGE(1, stats.atlasUploads, "New glyphs weren't uploaded to their page in one go!");
+}
+
+void test_prewarmed_glyphs_are_ready() {
+  // Digits haven't been drawn yet.
+  NR_Codepoint_Range digits = { '0', '9' };
+  NR_Font_Prewarm(font, &digits, 1);
+  NR_Font_WaitForGlyphs(font);
+
+  for (int i = 0; i < gridWidth * gridHeight; ++i) {
+    grid[i].codepoint = '0' + (i % 10);
+  }
+  NR_Font_Draw(font, grid, gridWidth, gridHeight, 0, 0, WIDTH, HEIGHT);
+
+  NR_Font_Stats stats;
+  NR_Font_GetStats(font, &stats);
+  TEST_ASSERT_EQUAL_MESSAGE(0, stats.cellsWaiting, "Prewarmed glyphs weren't ready!");
+}
+
+void test_cached_atlas_is_ready() {
+  NR_Font_SetCacheDirectory(".");
+
+  // Render a screen of glyphs with a font that saves its atlas when it's deleted.
+  NR_Font cached = NR_Font_Load(renderer, "data/font.ttf");
+  NR_Font_SetResolution(cached, 0, 20);
+  NR_Font_SetSize(cached, 0, 20);
+  _fillGrid(0, true);
+  NR_Font_Draw(cached, grid, gridWidth, gridHeight, 0, 0, WIDTH, HEIGHT);
+  NR_Font_WaitForGlyphs(cached);
+  NR_Font_Draw(cached, grid, gridWidth, gridHeight, 0, 0, WIDTH, HEIGHT);
+  NR_Font_Delete(cached);
+
+  // Loading it again, they should all be there for the first draw.
+  double start = glfwGetTime();
+  cached = NR_Font_Load(renderer, "data/font.ttf");
+  NR_Font_SetResolution(cached, 0, 20);
+  NR_Font_SetSize(cached, 0, 20);
+  NR_Font_Draw(cached, grid, gridWidth, gridHeight, 0, 0, WIDTH, HEIGHT);
+  double loadTime = (glfwGetTime() - start) * 1000.0;
+
+  NR_Font_Stats stats;
+  NR_Font_GetStats(cached, &stats);
+  NR_Font_Delete(cached);
+  NR_Font_SetCacheDirectory((void*)0);
+
+  printf("Load and first draw from the atlas cache %.3f ms\n", loadTime);
+
+  TEST_ASSERT_EQUAL_MESSAGE(0, stats.cellsWaiting, "Glyphs weren't loaded from the atlas cache!");
+}
+
+// Draw a screen of 26 letters from first with a font, waiting for them to be rendered, returning the stats.
+static void _drawLetters(NR_Font target, unsigned int first, NR_Font_Stats* stats) {
+  for (int i = 0; i < gridWidth * gridHeight; ++i) {
+    grid[i].codepoint = first + (i % 26);
+  }
+
+  NR_Font_Draw(target, grid, gridWidth, gridHeight, 0, 0, WIDTH, HEIGHT);
+  NR_Font_WaitForGlyphs(target);
+  NR_Font_Draw(target, grid, gridWidth, gridHeight, 0, 0, WIDTH, HEIGHT);
+  NR_Font_GetStats(target, stats);
+}
+
+void test_changing_resolution_back_is_free() {
+  NR_Font zoomed = NR_Font_Load(renderer, "data/font.ttf");
+  NR_Font_SetSize(zoomed, 0, 20);
+
+  // Render the same letters at two sizes.
+  NR_Font_Stats stats;
+  NR_Font_SetResolution(zoomed, 0, 20);
+  _drawLetters(zoomed, 'a', &stats);
+  NR_Font_SetResolution(zoomed, 0, 40);
+  _drawLetters(zoomed, 'a', &stats);
+
+  // Going back, the glyphs from before are still in the atlas.
+  NR_Font_SetResolution(zoomed, 0, 20);
+  NR_Font_Draw(zoomed, grid, gridWidth, gridHeight, 0, 0, WIDTH, HEIGHT);
+  NR_Font_GetStats(zoomed, &stats);
+  NR_Font_Delete(zoomed);
+
+  TEST_ASSERT_EQUAL_MESSAGE(0, stats.cellsWaiting, "Glyphs were rendered again after changing the resolution back!");
+  TEST_ASSERT_EQUAL_MESSAGE(0, stats.atlasUploads, "The atlas changed after changing the resolution back!");
+}
+
+void test_distance_fields_draw_at_any_resolution() {
+  if (!NR_GlyphRasterizer_HasDistanceFields())
+    TEST_IGNORE_MESSAGE("This freetype can't render distance fields.");
+
+  NR_Font scaled = NR_Font_Load(renderer, "data/font.ttf");
+  NR_Font_SetRaster(scaled, NR_FONT_RASTER_SDF);
+  NR_Font_SetSize(scaled, 0, 20);
+
+  NR_Font_Stats stats;
+  _drawLetters(scaled, 'a', &stats);
+  TEST_ASSERT_EQUAL_MESSAGE(0, stats.cellsWaiting, "Distance fields weren't rendered!");
+
+  // Distance fields are scaled, so a new resolution has nothing to render or rebuild.
+  NR_Font_SetResolution(scaled, 0, 40);
+  NR_Font_Draw(scaled, grid, gridWidth, gridHeight, 0, 0, WIDTH, HEIGHT);
+  NR_Font_GetStats(scaled, &stats);
+  TEST_ASSERT_EQUAL_MESSAGE(0, stats.cellsWaiting, "Glyphs were rendered again for a new resolution!");
+  TEST_ASSERT_EQUAL_MESSAGE(0, stats.cellsRebuilt, "Cells were rebuilt for a new resolution!");
+  TEST_ASSERT_EQUAL_MESSAGE(GL_NO_ERROR, glGetError(), "OpenGL error while drawing!");
+
+  NR_Font_Delete(scaled);
+}
+
+void test_full_atlas_grows_then_evicts() {
+  // Glyphs big enough that a page can't hold both cases.
+  NR_Font small = NR_Font_Load(renderer, "data/font.ttf");
+  NR_Font_SetAtlasBudget(small, 2 * 1024 * 1024);
+  NR_Font_SetResolution(small, 0, 300);
+  NR_Font_SetSize(small, 0, 20);
+
+  // With room in the budget, the atlas grows to hold both.
+  NR_Font_Stats stats;
+  _drawLetters(small, 'A', &stats);
+  _drawLetters(small, 'a', &stats);
+  TEST_ASSERT_EQUAL_MESSAGE(0, stats.cellsWaiting, "Glyphs were dropped when the atlas was full!");
+  TEST_ASSERT_EQUAL_MESSAGE(2, stats.atlasPages, "The atlas didn't grow!");
+  TEST_ASSERT_EQUAL_MESSAGE(0, stats.pagesEvicted, "A page was evicted while the atlas could grow!");
+
+  // With only a page, the capitals are off screen, so they make room for the lower case letters.
+  NR_Font_Delete(small);
+  small = NR_Font_Load(renderer, "data/font.ttf");
+  NR_Font_SetAtlasBudget(small, 1024 * 1024);
+  NR_Font_SetResolution(small, 0, 300);
+  NR_Font_SetSize(small, 0, 20);
+  _drawLetters(small, 'A', &stats);
+  _drawLetters(small, 'a', &stats);
+  TEST_ASSERT_EQUAL_MESSAGE(0, stats.cellsWaiting, "Glyphs were dropped when the atlas was full!");
+  TEST_ASSERT_EQUAL_MESSAGE(1, stats.pagesEvicted, "The full page wasn't evicted!");
+  TEST_ASSERT_MESSAGE(stats.glyphsEvicted > 0, "No glyphs were evicted!");
+
+  // Evicted glyphs are rendered again when they come back.
+  _drawLetters(small, 'A', &stats);
+  TEST_ASSERT_EQUAL_MESSAGE(0, stats.cellsWaiting, "Evicted glyphs weren't rendered again!");
+  TEST_ASSERT_EQUAL_MESSAGE(GL_NO_ERROR, glGetError(), "OpenGL error while drawing!");
+
+  NR_Font_Delete(small);
+}
+
+void test_pipelines() {
+  unsigned int uploaded;
+  double times[3];
+  const char* names[] = { "geometry shader", "instanced quads", "grid texture" };
+  NR_Font_Pipeline pipelines[] = { NR_FONT_PIPELINE_GEOMETRY, NR_FONT_PIPELINE_INSTANCED, NR_FONT_PIPELINE_GRID_TEXTURE };
+
+  // Draw the same fully churning grid with each pipeline.
+  for (int i = 0; i < 3; ++i) {
+    NR_Font_SetPipeline(font, pipelines[i]);
+    times[i] = _drawFrames(true, &uploaded);
+    TEST_ASSERT_EQUAL_MESSAGE(GL_NO_ERROR, glGetError(), "OpenGL error while drawing!");
+  }
+  NR_Font_SetPipeline(font, NR_FONT_PIPELINE_GEOMETRY);
+
+  for (int i = 0; i < 3; ++i) {
+    printf("%ix%i grid: %s %.3f ms/frame\n", gridWidth, gridHeight, names[i], times[i]);
+  }
+}
+
+void test_grid_texture_uploads_changed_rows() {
+  NR_Font_SetPipeline(font, NR_FONT_PIPELINE_GRID_TEXTURE);
+
+  // Once everything's uploaded, changing only the first row should upload just that row.
+  _fillGrid(0, true);
+  NR_Font_Draw(font, grid, gridWidth, gridHeight, 0, 0, WIDTH, HEIGHT);
+  _fillGrid(1, false);
+  NR_Font_Draw(font, grid, gridWidth, gridHeight, 0, 0, WIDTH, HEIGHT);
+
+  NR_Font_Stats stats;
+  NR_Font_GetStats(font, &stats);
+  NR_Font_SetPipeline(font, NR_FONT_PIPELINE_GEOMETRY);
+
+  TEST_ASSERT_EQUAL_MESSAGE(gridWidth, stats.cellsUploaded, "Unchanged rows were uploaded!");
+  TEST_ASSERT_EQUAL_MESSAGE(GL_NO_ERROR, glGetError(), "OpenGL error while drawing!");
+}
+
+void setUp() {
+  if (!window)
+    TEST_IGNORE_MESSAGE("Couldn't create an opengl context.");
+}
+
+int main(int argc, char** argv) {
+  // Make a hidden window to get an opengl context from.
+  if (glfwInit()) {
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+    window = glfwCreateWindow(WIDTH, HEIGHT, "Benchmark", (void*)0, (void*)0);
+  }
+
+  if (window) {
+    glfwMakeContextCurrent(window);
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+      glfwDestroyWindow(window);
+      window = (void*)0;
+    }
+  }
+
+  // Draw into our own framebuffer, so that nothing depends on the window being shown.
+  GLuint fbo = 0, colorBuffer = 0;
+  if (window) {
+    glGenRenderbuffers(1, &colorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, WIDTH, HEIGHT);
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+    glViewport(0, 0, WIDTH, HEIGHT);
+
+    // Only cache atlases in the tests that want to.
+    NR_Font_Init();
+    NR_Font_SetCacheDirectory((void*)0);
+    renderer = NR_Renderer_New();
+    font = NR_Font_Load(renderer, "data/font.ttf");
+    NR_Font_SetResolution(font, 0, 20);
+    NR_Font_SetSize(font, 0, 20);
+
+    int charWidth, charHeight;
+    NR_Font_GetSize(font, &charWidth, &charHeight);
+    gridWidth = WIDTH / charWidth;
+    gridHeight = HEIGHT / charHeight;
+    grid = calloc(gridWidth * gridHeight, sizeof(NR_Glyph));
+  }
+
+  UNITY_BEGIN();
+  RUN_TEST(test_static_vs_churn);
+  RUN_TEST(test_unchanged_frame_uploads_nothing);
+  RUN_TEST(test_scattered_changes_upload_together);
+  RUN_TEST(test_new_glyphs_dont_wait);
+  RUN_TEST(test_prewarmed_glyphs_are_ready);
+  RUN_TEST(test_cached_atlas_is_ready);
+  RUN_TEST(test_changing_resolution_back_is_free);
+  RUN_TEST(test_distance_fields_draw_at_any_resolution);
+  RUN_TEST(test_full_atlas_grows_then_evicts);
+  RUN_TEST(test_pipelines);
+  RUN_TEST(test_grid_texture_uploads_changed_rows);
+  int result = UNITY_END();
+
+  if (window) {
+    free(grid);
+    NR_Font_Delete(font);
+    NR_Renderer_Delete(renderer);
+    NR_Font_Shutdown();
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteRenderbuffers(1, &colorBuffer);
+    glfwDestroyWindow(window);
+    glfwTerminate();
+  }
+
+  return result;
+}
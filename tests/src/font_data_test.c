@@ -0,0 +1,59 @@
+#include <unity.h>
+#include <noroi/glfw_server/noroi_font_data.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void test_shared_data() {
+  NR_FontData first = NR_FontData_Open("data/font.ttf");
+  NR_FontData second = NR_FontData_Open("data/font.ttf");
+  TEST_ASSERT_MESSAGE(first, "Couldn't open the font!");
+  TEST_ASSERT_MESSAGE(first == second, "Opening the font again didn't share it!");
+
+  // It's all there, the same as reading the file.
+  FILE* file = fopen("data/font.ttf", "rb");
+  fseek(file, 0, SEEK_END);
+  unsigned int size = (unsigned int)ftell(file);
+  fseek(file, 0, SEEK_SET);
+  unsigned char* read = malloc(size);
+  TEST_ASSERT_EQUAL(size, fread(read, 1, size, file));
+  fclose(file);
+
+  TEST_ASSERT_EQUAL(size, NR_FontData_GetSize(first));
+  TEST_ASSERT_EQUAL_MEMORY_MESSAGE(read, NR_FontData_GetData(first), size, "The font's data doesn't match the file!");
+
+  // A copy of the font with a table's checksum changed is a different font.
+  read[12 + 8] ^= 0xFF;
+  file = fopen("changed_font.ttf", "wb");
+  TEST_ASSERT_EQUAL(size, fwrite(read, 1, size, file));
+  fclose(file);
+  free(read);
+
+  NR_FontData changed = NR_FontData_Open("changed_font.ttf");
+  TEST_ASSERT_MESSAGE(changed, "Couldn't open the changed font!");
+  TEST_ASSERT_MESSAGE(NR_FontData_GetHash(first) != NR_FontData_GetHash(changed), "The changed font has the same hash!");
+  NR_FontData_Release(changed);
+  remove("changed_font.ttf");
+
+  NR_FontData other = NR_FontData_Open("data/DejaVuSansMono.ttf");
+  TEST_ASSERT_MESSAGE(other, "Couldn't open the other font!");
+  TEST_ASSERT_MESSAGE(NR_FontData_GetHash(first) != NR_FontData_GetHash(other), "Two fonts have the same hash!");
+  NR_FontData_Release(other);
+
+  // Still usable until the last one lets go.
+  NR_FontData_Release(second);
+  TEST_ASSERT_EQUAL(size, NR_FontData_GetSize(first));
+  NR_FontData_Release(first);
+}
+
+void test_missing_font() {
+  TEST_ASSERT_MESSAGE(!NR_FontData_Open("data/no_such_font.ttf"), "Opened a font that isn't there!");
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_shared_data);
+  RUN_TEST(test_missing_font);
+  return UNITY_END();
+}
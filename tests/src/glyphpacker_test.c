@@ -1,7 +1,10 @@
 #include <unity.h>
 #include <noroi/glfw_server/noroi_glyphpacker.h>
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #define START_QUEUE_TEST(width, height, maxPage) \
   NR_GlyphPacker* g = NR_GlyphPacker_New(width, height, maxPage);
@@ -16,6 +19,7 @@ void test_add_remove() {
   const int toAdd = 4000;
   for (int i = 0; i < toAdd; ++i) {
     NR_GlyphPacker_Glyph glyph;
+    memset(&glyph, 0, sizeof(glyph));
     glyph.width = 10 + rand() % 30;
     glyph.height = 10 + rand() % 30;
     glyph.codepoint = i;
@@ -25,15 +29,191 @@ void test_add_remove() {
   // Check if they are there.
   for (int i = 0; i < toAdd; ++i) {
     NR_GlyphPacker_Glyph glyph;
-    TEST_ASSERT_MESSAGE(NR_GlyphPacker_Find(g, i, &glyph), "Couldn't find glyph in map!");
+    TEST_ASSERT_MESSAGE(NR_GlyphPacker_Find(g, i, 0, &glyph), "Couldn't find glyph in map!");
     TEST_ASSERT_MESSAGE(glyph.codepoint == i, "Found glyph doesn't match the one we were searching for!");
   }
 
   END_QUEUE_TEST
 }
 
+void test_uv() {
+  START_QUEUE_TEST(512, 256, 1)
+
+  NR_GlyphPacker_Glyph glyph;
+  memset(&glyph, 0, sizeof(glyph));
+  glyph.width = 64;
+  glyph.height = 32;
+  glyph.codepoint = 'A';
+  NR_GlyphPacker_Add(g, &glyph);
+
+  // The texture coordinates should cover exactly where it was packed.
+  TEST_ASSERT_MESSAGE(NR_GlyphPacker_Find(g, 'A', 0, &glyph), "Couldn't find glyph in map!");
+  TEST_ASSERT_EQUAL_FLOAT(glyph.x / 512.0f, glyph.uv[0]);
+  TEST_ASSERT_EQUAL_FLOAT(glyph.y / 256.0f, glyph.uv[1]);
+  TEST_ASSERT_EQUAL_FLOAT((glyph.x + 64) / 512.0f, glyph.uv[2]);
+  TEST_ASSERT_EQUAL_FLOAT((glyph.y + 32) / 256.0f, glyph.uv[3]);
+
+  END_QUEUE_TEST
+}
+
+void test_clear_page() {
+  START_QUEUE_TEST(64, 64, 1)
+
+  // Fill the page.
+  NR_GlyphPacker_Glyph glyph;
+  memset(&glyph, 0, sizeof(glyph));
+  glyph.width = 31;
+  glyph.height = 31;
+  for (int i = 0; i < 4; ++i) {
+    glyph.codepoint = i;
+    TEST_ASSERT_MESSAGE(NR_GlyphPacker_Add(g, &glyph), "Couldn't add glyph to an empty page!");
+  }
+  glyph.codepoint = 4;
+  TEST_ASSERT_MESSAGE(!NR_GlyphPacker_Add(g, &glyph), "Added glyph to a full page!");
+
+  // A new page makes room.
+  NR_GlyphPacker_SetPageCount(g, 2);
+  TEST_ASSERT_EQUAL(2, NR_GlyphPacker_GetPageCount(g));
+  TEST_ASSERT_MESSAGE(NR_GlyphPacker_Add(g, &glyph), "Couldn't add glyph to a new page!");
+  TEST_ASSERT_MESSAGE(NR_GlyphPacker_Find(g, 4, 0, &glyph), "Couldn't find glyph in map!");
+  TEST_ASSERT_EQUAL(1, glyph.page);
+
+  // Clearing the first page removes only its glyphs, and its room can be used again.
+  NR_GlyphPacker_ClearPage(g, 0);
+  TEST_ASSERT_MESSAGE(!NR_GlyphPacker_Find(g, 0, 0, &glyph), "Found glyph from a cleared page!");
+  TEST_ASSERT_MESSAGE(NR_GlyphPacker_Find(g, 4, 0, &glyph), "Glyph on another page was removed!");
+
+  glyph.codepoint = 5;
+  TEST_ASSERT_MESSAGE(NR_GlyphPacker_AddToPage(g, &glyph, 0), "Couldn't add glyph to a cleared page!");
+  TEST_ASSERT_MESSAGE(NR_GlyphPacker_Find(g, 5, 0, &glyph), "Couldn't find glyph in map!");
+  TEST_ASSERT_EQUAL(0, glyph.page);
+
+  END_QUEUE_TEST
+}
+
+// Make a glyph about the size of one from a terminal font. Most are about as tall as each other, with a few short ones.
+static void _terminalGlyph(NR_GlyphPacker_Glyph* glyph, unsigned int codepoint) {
+  memset(glyph, 0, sizeof(NR_GlyphPacker_Glyph));
+  glyph->codepoint = codepoint;
+  glyph->width = 6 + rand() % 8;
+  glyph->height = (rand() % 10 < 7) ? 14 + rand() % 6 : 2 + rand() % 10;
+}
+
+// Add glyphs to a packer, returning how many went on, and the time and page area they took.
+static unsigned int _pack(NR_GlyphPacker_Method method, int maxPage, unsigned int count, double* seconds, double* coverage) {
+  NR_GlyphPacker* g = NR_GlyphPacker_NewWithMethod(1024, 1024, maxPage, method);
+
+  srand(1);
+  unsigned int added = 0;
+  double area = 0.0;
+  clock_t start = clock();
+  for (unsigned int i = 0; i < count; ++i) {
+    NR_GlyphPacker_Glyph glyph;
+    _terminalGlyph(&glyph, i);
+    if (NR_GlyphPacker_Add(g, &glyph)) {
+      added++;
+      area += (glyph.width + 1) * (glyph.height + 1);
+    }
+  }
+  *seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+  *coverage = area / (1024.0 * 1024.0 * maxPage);
+
+  NR_GlyphPacker_Delete(g);
+  return added;
+}
+
+void test_find_codepoints() {
+  START_QUEUE_TEST(1024, 1024, 2)
+
+  // Codepoints looked up directly and through the table, on both pages.
+  const unsigned int codepoints[] = { 0, 'A', 0x7FF, 0x800, 0x4E00, 0x1F600, 0x10FFFF };
+  const int count = sizeof(codepoints) / sizeof(codepoints[0]);
+  for (int i = 0; i < count; ++i) {
+    NR_GlyphPacker_Glyph glyph;
+    memset(&glyph, 0, sizeof(glyph));
+    glyph.width = 10;
+    glyph.height = 10;
+    glyph.codepoint = codepoints[i];
+    glyph.index = i;
+    TEST_ASSERT_MESSAGE(NR_GlyphPacker_AddToPage(g, &glyph, i % 2), "Couldn't add glyph!");
+  }
+
+  // Enough CJK to grow the table.
+  for (unsigned int i = 0; i < 2000; ++i) {
+    NR_GlyphPacker_Glyph glyph;
+    _terminalGlyph(&glyph, 0x4E01 + i);
+    NR_GlyphPacker_AddToPage(g, &glyph, 1);
+  }
+
+  // The same codepoints at other sizes, looked up directly and through the table.
+  const unsigned int variants[] = { 5, 1000 };
+  for (int v = 0; v < 2; ++v) {
+    for (int i = 0; i < count; ++i) {
+      NR_GlyphPacker_Glyph glyph;
+      memset(&glyph, 0, sizeof(glyph));
+      glyph.width = 12;
+      glyph.height = 12;
+      glyph.codepoint = codepoints[i];
+      glyph.variant = variants[v];
+      glyph.index = (v + 1) * count + i;
+      TEST_ASSERT_MESSAGE(NR_GlyphPacker_AddToPage(g, &glyph, 0), "Couldn't add glyph!");
+    }
+  }
+
+  for (int i = 0; i < count; ++i) {
+    NR_GlyphPacker_Glyph glyph;
+    TEST_ASSERT_MESSAGE(NR_GlyphPacker_Find(g, codepoints[i], 0, &glyph), "Couldn't find glyph in map!");
+    TEST_ASSERT_EQUAL(i, glyph.index);
+    for (int v = 0; v < 2; ++v) {
+      TEST_ASSERT_MESSAGE(NR_GlyphPacker_Find(g, codepoints[i], variants[v], &glyph), "Couldn't find glyph at another size!");
+      TEST_ASSERT_EQUAL((v + 1) * count + i, glyph.index);
+    }
+  }
+
+  // Clearing a page leaves the other's glyphs findable.
+  NR_GlyphPacker_Glyph glyph;
+  NR_GlyphPacker_ClearPage(g, 1);
+  for (int i = 0; i < count; ++i) {
+    TEST_ASSERT_EQUAL_MESSAGE(i % 2 == 0, NR_GlyphPacker_Find(g, codepoints[i], 0, &glyph), "Cleared the wrong glyphs!");
+  }
+  TEST_ASSERT_MESSAGE(!NR_GlyphPacker_Find(g, 0x4E01, 0, &glyph), "Found glyph from a cleared page!");
+  TEST_ASSERT_MESSAGE(!NR_GlyphPacker_Find(g, 'B', 0, &glyph), "Found glyph that was never added!");
+  TEST_ASSERT_MESSAGE(!NR_GlyphPacker_Find(g, 'A', 6, &glyph), "Found glyph at a size it was never added at!");
+
+  END_QUEUE_TEST
+}
+
+void test_packing_efficiency() {
+  // Offer a page more glyphs than it could hold, and see how many each method gets on.
+  double seconds, treeCoverage, skylineCoverage;
+  unsigned int tree = _pack(NR_GLYPHPACKER_METHOD_TREE, 1, 20000, &seconds, &treeCoverage);
+  unsigned int skyline = _pack(NR_GLYPHPACKER_METHOD_SKYLINE, 1, 20000, &seconds, &skylineCoverage);
+
+  printf("One page: tree fits %u glyphs (%.1f%% covered), skyline fits %u glyphs (%.1f%% covered)\n",
+         tree, treeCoverage * 100.0, skyline, skylineCoverage * 100.0);
+
+  TEST_ASSERT_MESSAGE(skyline >= tree, "The skyline packer fits fewer glyphs than the tree!");
+}
+
+void test_insertion_time() {
+  // Fill a couple of pages.
+  double treeSeconds, skylineSeconds, coverage;
+  unsigned int tree = _pack(NR_GLYPHPACKER_METHOD_TREE, 2, 12000, &treeSeconds, &coverage);
+  unsigned int skyline = _pack(NR_GLYPHPACKER_METHOD_SKYLINE, 2, 12000, &skylineSeconds, &coverage);
+
+  printf("Two pages: tree %.3f us per glyph (%u added), skyline %.3f us per glyph (%u added)\n",
+         treeSeconds * 1e6 / 12000, tree, skylineSeconds * 1e6 / 12000, skyline);
+
+  TEST_ASSERT_MESSAGE(skyline >= tree, "The skyline packer fits fewer glyphs than the tree!");
+}
+
 int main(int argc, char** argv) {
   UNITY_BEGIN();
   RUN_TEST(test_add_remove);
+  RUN_TEST(test_uv);
+  RUN_TEST(test_clear_page);
+  RUN_TEST(test_find_codepoints);
+  RUN_TEST(test_packing_efficiency);
+  RUN_TEST(test_insertion_time);
   return UNITY_END();
 }